@@ -241,6 +241,7 @@ initIDT:# Add descriptors for exception & interrupt handlers:
         # user mode without generating a general protection fault, so they
         # will be tagged with dpl=3
 	idtcalc	handler=kputc, slot=0x80, dpl=3
+	idtcalc	handler=kwrite, slot=0x81, dpl=3
 
 	# Install the new IDT:
 	lidt	idtptr
@@ -324,6 +325,15 @@ kputc:	subl	$4, %esp	# Fake an error code
 	leal	stack, %esp	# Switch to kernel stack
 	jmp	kputc_imp
 
+kwrite:	subl	$4, %esp	# Fake an error code
+	push	%gs		# Save segments
+	push	%fs
+	push	%es
+	push	%ds
+	pusha			# Save registers
+	leal	stack, %esp	# Switch to kernel stack
+	jmp	kwrite_imp
+
 #--------------------------------------------------------------------------
 # Switch to user mode:  Takes a single parameter, which provides the
 # initial context for the user process.
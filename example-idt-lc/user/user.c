@@ -22,11 +22,14 @@
 #include "simpleio.h"
 
 extern void kputc(unsigned);
+extern unsigned kwrite(char* buf, unsigned len);
 
 void kputs(char* s) {
-  while (*s) {
-    kputc(*s++);
+  unsigned len = 0;
+  while (s[len]) {
+    len++;
   }
+  kwrite(s, len);
 }
 
 extern void serial_putc(int c);
@@ -15,3 +15,11 @@ kputc:	pushl	%eax
 	popl	%eax
 	ret
 
+
+	# System call to print a block of text in the kernel's window;
+	# returns the number of characters printed
+	.globl	kwrite
+kwrite:	movl	4(%esp), %eax
+	movl	8(%esp), %ecx
+	int	$129
+	ret
@@ -0,0 +1,40 @@
+target triple = "i386-pc-linux-gnu"
+
+; The local APIC registers are memory mapped at 0xfee00000, with each
+; register aligned on a 16 byte boundary.  All accesses must be 32 bits
+; wide, and they are volatile so that polling loops are not optimized away.
+
+define linkonce_odr i32 @lapicRead(i32 %reg) #0 {
+  %addr = add i32 %reg, 4276092928
+  %ptr  = inttoptr i32 %addr to i32*
+  %val  = load volatile i32, i32* %ptr
+  ret i32 %val
+}
+
+define linkonce_odr void @lapicWrite(i32 %reg, i32 %val) #0 {
+  %addr = add i32 %reg, 4276092928
+  %ptr  = inttoptr i32 %addr to i32*
+  store volatile i32 %val, i32* %ptr
+  ret void
+}
+
+; The IO APIC is accessed indirectly: the number of a register is written
+; to the select register at 0xfec00000, and the register's value can then
+; be read or written through the window register at 0xfec00010.
+define linkonce_odr i32 @ioapicRead(i32 %reg) #0 {
+  %sel  = inttoptr i32 4273995776 to i32*
+  %win  = inttoptr i32 4273995792 to i32*
+  store volatile i32 %reg, i32* %sel
+  %val  = load volatile i32, i32* %win
+  ret i32 %val
+}
+
+define linkonce_odr void @ioapicWrite(i32 %reg, i32 %val) #0 {
+  %sel  = inttoptr i32 4273995776 to i32*
+  %win  = inttoptr i32 4273995792 to i32*
+  store volatile i32 %reg, i32* %sel
+  store volatile i32 %val, i32* %win
+  ret void
+}
+
+attributes #0 = { alwaysinline nounwind "no-frame-pointer-elim"="false" "no-frame-pointer-elim-non-leaf" }
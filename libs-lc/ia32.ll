@@ -14,6 +14,41 @@ define linkonce_odr i32 @inb(i32 %portw) #0 {
   ret i32 %bytew
 }
 
+define linkonce_odr void @outw(i32 %portw, i32 %valw) #0 {
+  %port = trunc i32 %portw to i16
+  %val  = trunc i32 %valw to i16
+  call void asm sideeffect "outw  $1, $0", "{dx}N,{ax},~{flags}"(i16 %port, i16 %val)
+  ret void
+}
+
+define linkonce_odr i32 @inw(i32 %portw) #0 {
+  %port = trunc i32 %portw to i16
+  %val  = call i16 asm sideeffect "inw $1, $0", "={ax},{dx}N,~{flags}"(i16 %port)
+  %valw = zext i16 %val to i32
+  ret i32 %valw
+}
+
+define linkonce_odr void @outl(i32 %portw, i32 %val) #0 {
+  %port = trunc i32 %portw to i16
+  call void asm sideeffect "outl  $1, $0", "{dx}N,{ax},~{flags}"(i16 %port, i32 %val)
+  ret void
+}
+
+define linkonce_odr i32 @inl(i32 %portw) #0 {
+  %port = trunc i32 %portw to i16
+  %val  = call i32 asm sideeffect "inl $1, $0", "={ax},{dx}N,~{flags}"(i16 %port)
+  ret i32 %val
+}
+
+; Write len bytes, starting at addr, to the given port using a single
+; rep outsb instruction (so a hypervisor can handle the whole block in
+; one exit, instead of one exit for each byte).
+define linkonce_odr void @outsb(i32 %portw, i32 %addr, i32 %len) #0 {
+  %port = trunc i32 %portw to i16
+  call { i32, i32 } asm sideeffect "rep outsb", "={si},={cx},{dx},0,1,~{memory},~{flags}"(i16 %port, i32 %addr, i32 %len)
+  ret void
+}
+
 define linkonce_odr i32 @getCR2() #0 {
   %faultaddr = call i32 asm sideeffect "mov %cr2, $0", "=r,~{flags}"()
   ret i32 %faultaddr
@@ -29,11 +64,190 @@ define linkonce_odr void @setCR3(i32 %pdir) #0 {
   ret void
 }
 
+; Turn on PAE paging using the PDPT in the given cr3 value.  This sets
+; CR4.PAE, loads cr3, and then sets CR0.PG, so it must only be called
+; while paging is disabled.
+define linkonce_odr void @enablePAEPaging(i32 %pdpt) #0 {
+  call void asm sideeffect "movl %cr4, %eax\0Aorl $$0x20, %eax\0Amovl %eax, %cr4\0Amovl $0, %cr3\0Amovl %cr0, %eax\0Aorl $$0x80000000, %eax\0Amovl %eax, %cr0", "{cx},~{eax},~{memory},~{flags}"(i32 %pdpt)
+  ret void
+}
+
 define linkonce_odr void @invlpg(i8* %addr) #0 {
   call void asm sideeffect "invlpg ($0)", "{bx},~{memory},~{flags}"(i8* %addr)
   ret void
 }
 
+define linkonce_odr void @cli() #0 {
+  call void asm sideeffect "cli", "~{memory},~{flags}"()
+  ret void
+}
+
+define linkonce_odr void @sti() #0 {
+  call void asm sideeffect "sti", "~{memory},~{flags}"()
+  ret void
+}
+
+; Enable interrupts and halt until the next one arrives.  The sti shadow
+; guarantees that no interrupt is taken between the sti and the hlt, so a
+; caller that tests for work with interrupts disabled cannot miss a wakeup.
+; Interrupts are disabled again on return.
+define linkonce_odr void @waitForInterrupt() #0 {
+  call void asm sideeffect "sti\0Ahlt\0Acli", "~{memory},~{flags}"()
+  ret void
+}
+
+; FPU/SSE state management.  fxsave and fxrstor require a 16 byte aligned
+; 512 byte buffer.  fpuDisable sets CR0.TS so that the next FPU or SSE
+; instruction raises a device-not-available (#NM) exception, and
+; fpuEnable clears it again.
+define linkonce_odr void @fxsave(i8* %addr) #0 {
+  call void asm sideeffect "fxsave ($0)", "r,~{memory}"(i8* %addr)
+  ret void
+}
+
+define linkonce_odr void @fxrstor(i8* %addr) #0 {
+  call void asm sideeffect "fxrstor ($0)", "r,~{memory}"(i8* %addr)
+  ret void
+}
+
+define linkonce_odr void @finit() #0 {
+  call void asm sideeffect "fninit", "~{memory}"()
+  ret void
+}
+
+; An FXSAVE image of the FPU and SSE state after a processor reset:
+; FCW=0x37f and MXCSR=0x1f80 (all exceptions masked), and every other
+; field, including the x87 and XMM registers, zero.  fpuReset loads it.
+; Unlike finit, this also clears MXCSR and the XMM registers, so no SSE
+; state is left over from a previous user of the FPU.
+@fpuDefaultState = linkonce_odr constant <{ i16, [22 x i8], i32, [484 x i8] }>
+  <{ i16 895, [22 x i8] zeroinitializer, i32 8064, [484 x i8] zeroinitializer }>, align 16
+
+define linkonce_odr void @fpuReset() #0 {
+  call void asm sideeffect "fxrstor ($0)", "r,~{memory}"(i8* bitcast (<{ i16, [22 x i8], i32, [484 x i8] }>* @fpuDefaultState to i8*))
+  ret void
+}
+
+define linkonce_odr void @fpuEnable() #0 {
+  call void asm sideeffect "clts", "~{memory}"()
+  ret void
+}
+
+define linkonce_odr void @fpuDisable() #0 {
+  call void asm sideeffect "movl %cr0, %eax\0Aorl $$8, %eax\0Amovl %eax, %cr0", "~{eax},~{memory},~{flags}"()
+  ret void
+}
+
+; Atomically exchange the word at the given address with a new value,
+; returning the previous contents.  This is a full memory barrier.
+define linkonce_odr i32 @xchg(i8* %addr, i32 %val) #0 {
+  %ptr = bitcast i8* %addr to i32*
+  %old = atomicrmw xchg i32* %ptr, i32 %val seq_cst
+  ret i32 %old
+}
+
+; Atomically compare the word at the given address with an expected
+; value and, if they are equal, replace it with a new value (lock
+; cmpxchg).  Returns the previous contents, so the update succeeded if
+; the result is equal to the expected value.  This is a full barrier.
+define linkonce_odr i32 @cmpxchg(i8* %addr, i32 %expected, i32 %new) #0 {
+  %ptr  = bitcast i8* %addr to i32*
+  %pair = cmpxchg i32* %ptr, i32 %expected, i32 %new seq_cst seq_cst
+  %old  = extractvalue { i32, i1 } %pair, 0
+  ret i32 %old
+}
+
+; Atomically add a value to the word at the given address (lock xadd),
+; returning the previous contents.  This is a full barrier.
+define linkonce_odr i32 @xadd(i8* %addr, i32 %val) #0 {
+  %ptr = bitcast i8* %addr to i32*
+  %old = atomicrmw add i32* %ptr, i32 %val seq_cst
+  ret i32 %old
+}
+
+; Add a value to the word at the given address with a single addl
+; instruction, but without a lock prefix.  This cannot be split by an
+; interrupt on the same cpu, so it is safe for counters that are only
+; updated by one cpu, but it is not atomic with respect to other cpus.
+define linkonce_odr void @localAdd(i8* %addr, i32 %val) #0 {
+  call void asm sideeffect "addl $1, ($0)", "r,r,~{memory},~{flags}"(i8* %addr, i32 %val)
+  ret void
+}
+
+; Hint to the processor that we are in a spin-wait loop.  The memory
+; clobber also stops the compiler from hoisting loads out of the loop.
+define linkonce_odr void @pause() #0 {
+  call void asm sideeffect "pause", "~{memory}"()
+  ret void
+}
+
+; A full memory fence, which orders earlier stores before later loads;
+; this is the only reordering that an IA32 processor performs on normal
+; memory accesses.
+define linkonce_odr void @memoryFence() #0 {
+  fence seq_cst
+  ret void
+}
+
+; A compiler-only barrier, which stops the compiler from moving memory
+; accesses across it.  Because IA32 does not reorder loads with other
+; loads, or stores with other stores, this is enough to order the data
+; and index updates in a single producer/single consumer ring.
+define linkonce_odr void @compilerBarrier() #0 {
+  call void asm sideeffect "", "~{memory}"()
+  ret void
+}
+
+; Read the 64 bit time stamp counter into the two words at the given address
+; (low word first).
+define linkonce_odr void @rdtsc(i8* %addr) #0 {
+  %tsc = call i64 asm sideeffect "rdtsc", "=A"()
+  %ptr = bitcast i8* %addr to i64*
+  store i64 %tsc, i64* %ptr
+  ret void
+}
+
+; Execute cpuid for the given leaf (with ecx=0 for leaves that have
+; subleaves) and return the value that it leaves in edx.
+define linkonce_odr i32 @cpuidEDX(i32 %leaf) #0 {
+  %r   = call { i32, i32, i32, i32 } asm sideeffect "cpuid", "={ax},={bx},={cx},={dx},0,2,~{flags}"(i32 %leaf, i32 0)
+  %edx = extractvalue { i32, i32, i32, i32 } %r, 3
+  ret i32 %edx
+}
+
+; Execute cpuid for the given leaf (with ecx=0) and store the values that
+; it leaves in eax, ebx, ecx, and edx in the four words at the given address.
+define linkonce_odr void @cpuid(i32 %leaf, i8* %addr) #0 {
+  %r   = call { i32, i32, i32, i32 } asm sideeffect "cpuid", "={ax},={bx},={cx},={dx},0,2,~{flags}"(i32 %leaf, i32 0)
+  %ptr = bitcast i8* %addr to i32*
+  %eax = extractvalue { i32, i32, i32, i32 } %r, 0
+  %ebx = extractvalue { i32, i32, i32, i32 } %r, 1
+  %ecx = extractvalue { i32, i32, i32, i32 } %r, 2
+  %edx = extractvalue { i32, i32, i32, i32 } %r, 3
+  %p1  = getelementptr i32, i32* %ptr, i32 1
+  %p2  = getelementptr i32, i32* %ptr, i32 2
+  %p3  = getelementptr i32, i32* %ptr, i32 3
+  store i32 %eax, i32* %ptr
+  store i32 %ebx, i32* %p1
+  store i32 %ecx, i32* %p2
+  store i32 %edx, i32* %p3
+  ret void
+}
+
+; Set CR4.PGE, so that translations for pages and superpages that are
+; marked as global are kept in the TLB when cr3 is changed.
+define linkonce_odr void @enableGlobalPages() #0 {
+  call void asm sideeffect "movl %cr4, %eax\0Aorl $$0x80, %eax\0Amovl %eax, %cr4", "~{eax},~{memory},~{flags}"()
+  ret void
+}
+
+; Set CR4.PSE, so that PDEs with the PS bit set are treated as 4MB
+; superpage mappings (the PS bit is ignored until this is done).
+define linkonce_odr void @enablePSE() #0 {
+  call void asm sideeffect "movl %cr4, %eax\0Aorl $$0x10, %eax\0Amovl %eax, %cr4", "~{eax},~{memory},~{flags}"()
+  ret void
+}
+
 attributes #0 = { alwaysinline nounwind "no-frame-pointer-elim"="false" "no-frame-pointer-elim-non-leaf" }
 attributes #1 = { noinline optnone "no-frame-pointer-elim"="false" "no-frame-pointer-elim-non-leaf" }
 attributes #2 = { alwaysinline nounwind ssp uwtable "no-frame-pointer-elim"="false" "no-frame-pointer-elim-non-leaf" }
@@ -0,0 +1,22 @@
+target triple = "i386-pc-linux-gnu"
+
+; Scan code set 1 translation tables for a standard US keyboard layout.
+; Unused codes map to zero; function keys F1-F12 map to 0x81-0x8c.
+
+@kbdNormal = linkonce_odr constant [128 x i8]
+    c"\00\1B1234567890-=\08\09qwertyuiop[]\0D\00asdfghjkl;'`\00\5Czxcvbnm,./\00*\00 \00\81\82\83\84\85\86\87\88\89\8A\00\00789-456+1230.\00\00\00\8B\8C\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00"
+
+@kbdShifted = linkonce_odr constant [128 x i8]
+    c"\00\1B!@#$%^&*()_+\08\09QWERTYUIOP{}\0D\00ASDFGHJKL:\22~\00|ZXCVBNM<>?\00*\00 \00\81\82\83\84\85\86\87\88\89\8A\00\00789-456+1230.\00\00\00\8B\8C\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00\00"
+
+define linkonce_odr i32 @kbdDecode(i32 %codew, i32 %shiftw) #0 {
+  %code    = and i32 %codew, 127
+  %shift   = icmp ne i32 %shiftw, 0
+  %table   = select i1 %shift, [128 x i8]* @kbdShifted, [128 x i8]* @kbdNormal
+  %ptr     = getelementptr [128 x i8], [128 x i8]* %table, i32 0, i32 %code
+  %char    = load i8, i8* %ptr
+  %charw   = zext i8 %char to i32
+  ret i32 %charw
+}
+
+attributes #0 = { alwaysinline nounwind "no-frame-pointer-elim"="false" "no-frame-pointer-elim-non-leaf" }
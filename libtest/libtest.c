@@ -0,0 +1,669 @@
+/* ------------------------------------------------------------------------
+ * libtest.c:  host-side property tests and benchmarks for libs-lc
+ *
+ * This program is linked with libtest.llc, which milc compiles (together
+ * with the libs-lc modules that it requires) for a 32 bit Linux host, in
+ * the same way that it compiles a kernel.  The entry points in libtest.llc
+ * are called directly from C, and report their results by calling the
+ * testWord, testInterval, and testFPage functions below.  Output that the
+ * library code would send to the serial port is passed to sputchar, which
+ * captures it when we want to check it, and discards it otherwise.
+ *
+ * Usage:  libtest [options]
+ *
+ *   -n n       number of random cases for each property (default 10000)
+ *   -s seed    random seed (default 1)
+ *   -b         run the benchmarks instead of the property tests
+ *   -r n       number of repetitions for each benchmark (default 100000)
+ *   -v         describe each failure in detail
+ *
+ * The properties that are tested are:
+ *
+ *   intervals  insertInterval and reserveInterval give the same set as a
+ *              simple model (including the documented behavior when the
+ *              set is full), sortIntervals sorts, and the stored intervals
+ *              are always separate.
+ *   fpages     enumFPages covers exactly the whole pages in a range, with
+ *              aligned fpages in increasing order, each as large as it can
+ *              be.
+ *   cursors    the cursors in mimg.llc visit every header and memory map
+ *              entry in a boot data structure, in order.
+ *   format     putUnsigned, putSigned, putHex, putOctal, and putBin (all
+ *              built on hputDigitsFmt) print values that read back as the
+ *              original numbers.
+ *
+ * The exit status is the number of properties that failed (0 if all pass).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef unsigned long long u64;
+
+/* ------------------------------------------------------------------------
+ * Entry points in libtest.llc:
+ */
+extern void libtest(void);
+extern void setClear(void);
+extern void setInsert(unsigned lo, unsigned hi);
+extern void setReserve(unsigned lo, unsigned hi);
+extern void setSort(void);
+extern void setDump(void);
+extern void fpages(unsigned lo, unsigned hi);
+extern void walkHeaders(unsigned bd);
+extern void walkMMap(unsigned bd);
+extern void walkMMap64(unsigned bd);
+extern void fmtUnsigned(unsigned n);
+extern void fmtSigned(unsigned n);
+extern void fmtHex(unsigned n);
+extern void fmtOctal(unsigned n);
+extern void fmtBin(unsigned n);
+extern void fmtSize(unsigned n);
+
+/* ------------------------------------------------------------------------
+ * Results reported by the library code:
+ */
+#define MAXRESULTS 1024
+
+static unsigned words[MAXRESULTS];    /* values passed to testWord        */
+static unsigned numWords;
+static unsigned pairs[MAXRESULTS][3]; /* testInterval and testFPage args  */
+static unsigned numPairs;
+static int      recording = 1;        /* 0 => only count results          */
+static unsigned long long reported;   /* total number of results          */
+
+void testWord(unsigned w) {
+  reported++;
+  if (recording && numWords<MAXRESULTS) {
+    words[numWords++] = w;
+  }
+}
+
+void testInterval(unsigned lo, unsigned hi) {
+  reported++;
+  if (recording && numPairs<MAXRESULTS) {
+    pairs[numPairs][0] = lo;
+    pairs[numPairs][1] = hi;
+    pairs[numPairs][2] = 0;
+    numPairs++;
+  }
+}
+
+void testFPage(unsigned lo, unsigned hi, unsigned bits) {
+  testInterval(lo, hi);
+  if (recording && numPairs>0) {
+    pairs[numPairs-1][2] = bits;
+  }
+}
+
+static void resetResults() {
+  numWords = 0;
+  numPairs = 0;
+}
+
+/* Characters for the "serial port":
+ */
+static char     outBuf[256];
+static unsigned outLen;
+
+void sputchar(unsigned c) {
+  if (recording && outLen+1<sizeof(outBuf)) {
+    outBuf[outLen++] = (char)c;
+    outBuf[outLen]   = '\0';
+  }
+}
+
+void swrite(unsigned buf, unsigned len) {
+  for (; len>0; len--) {
+    sputchar(*(unsigned char*)buf++);
+  }
+}
+
+static void resetOutput() {
+  outLen    = 0;
+  outBuf[0] = '\0';
+}
+
+/* ------------------------------------------------------------------------
+ * Random values, favoring the edges of the address space and of pages:
+ */
+static int verbose = 0;
+
+static unsigned rnd(unsigned n) {     /* Random number in [0..n) */
+  return n ? (unsigned)random() % n : 0;
+}
+
+static unsigned rndWord() {
+  return ((unsigned)random() << 16) ^ (unsigned)random();
+}
+
+static unsigned rndAddr() {
+  unsigned page = rnd(4)==0 ? 0xfffff - rnd(16) : rnd(64);
+  switch (rnd(4)) {
+    case 0  : return page << 12;
+    case 1  : return (page << 12) | 0xfff;
+    case 2  : return (page << 12) + rnd(0x1000);
+    default : return rnd(8)==0 ? rndWord() : (page << 12) + rnd(2);
+  }
+}
+
+/* ------------------------------------------------------------------------
+ * A model of interval sets:  A list of separate (that is, neither
+ * overlapping nor adjacent) intervals in increasing order, using 64 bit
+ * arithmetic so that there are no overflow cases to worry about.
+ */
+#define NUMINTERVALS 8                /* must match NumIntervals          */
+#define MAXMODEL     (2*NUMINTERVALS+2)
+
+struct Model {
+  unsigned n;
+  u64      lo[MAXMODEL], hi[MAXMODEL];
+};
+
+static void modelInsert(struct Model* m, u64 lo, u64 hi) {
+  struct Model r;
+  unsigned i  = 0;
+  r.n = 0;
+  for (; i<m->n && m->hi[i]+1<lo; i++) {        /* intervals below      */
+    r.lo[r.n] = m->lo[i]; r.hi[r.n] = m->hi[i]; r.n++;
+  }
+  for (; i<m->n && m->lo[i]<=hi+1; i++) {       /* merge with new       */
+    if (m->lo[i]<lo) lo = m->lo[i];
+    if (m->hi[i]>hi) hi = m->hi[i];
+  }
+  r.lo[r.n] = lo; r.hi[r.n] = hi; r.n++;
+  for (; i<m->n; i++) {                         /* intervals above      */
+    r.lo[r.n] = m->lo[i]; r.hi[r.n] = m->hi[i]; r.n++;
+  }
+  *m = r;
+}
+
+/* When the set is full, reserving the middle of an interval only keeps
+ * the part below the reserved interval (see reserveInterval).
+ */
+static void modelReserve(struct Model* m, u64 lo, u64 hi) {
+  struct Model r;
+  unsigned i;
+  r.n = 0;
+  for (i=0; i<m->n; i++) {
+    if (m->hi[i]<lo || hi<m->lo[i]) {
+      r.lo[r.n] = m->lo[i]; r.hi[r.n] = m->hi[i]; r.n++;
+    } else {
+      if (m->lo[i]<lo) {
+        r.lo[r.n] = m->lo[i]; r.hi[r.n] = lo-1; r.n++;
+      }
+      if (hi<m->hi[i] && !(m->lo[i]<lo && m->n==NUMINTERVALS)) {
+        r.lo[r.n] = hi+1; r.hi[r.n] = m->hi[i]; r.n++;
+      }
+    }
+  }
+  *m = r;
+}
+
+/* Compare the set in libtest.llc with a model, after sorting the stored
+ * intervals if sort is set; returns a description of any difference.
+ */
+static const char* checkSet(struct Model* m, int sort) {
+  unsigned i, j;
+  resetResults();
+  if (sort) {
+    setSort();
+  }
+  setDump();
+  if (numPairs!=m->n) {
+    return "wrong number of intervals";
+  }
+  for (i=0; i<numPairs; i++) {
+    if (pairs[i][1]<pairs[i][0]) {
+      return "interval with hi < lo";
+    }
+    for (j=0; j<i; j++) {
+      if (!((u64)pairs[i][1]+1<pairs[j][0] || (u64)pairs[j][1]+1<pairs[i][0])) {
+        return "intervals are not separate";
+      }
+    }
+  }
+  if (sort) {
+    for (i=0; i<numPairs; i++) {
+      if (pairs[i][0]!=m->lo[i] || pairs[i][1]!=m->hi[i]) {
+        return "sorted set does not match model";
+      }
+    }
+  } else {
+    for (i=0; i<m->n; i++) {
+      for (j=0; j<numPairs; j++) {
+        if (pairs[j][0]==m->lo[i] && pairs[j][1]==m->hi[i]) {
+          break;
+        }
+      }
+      if (j==numPairs) {
+        return "set does not match model";
+      }
+    }
+  }
+  return 0;
+}
+
+static void showModel(struct Model* m) {
+  unsigned i;
+  printf("  expected:");
+  for (i=0; i<m->n; i++) {
+    printf(" [%llx-%llx]", m->lo[i], m->hi[i]);
+  }
+  printf("\n  actual:  ");
+  for (i=0; i<numPairs; i++) {
+    printf(" [%x-%x]", pairs[i][0], pairs[i][1]);
+  }
+  printf("\n");
+}
+
+static int testIntervals(int iters) {
+  int failures = 0;
+  int k;
+  for (k=0; k<iters && failures<10; k++) {
+    struct Model m;
+    int ops = 1 + rnd(40);
+    m.n = 0;
+    setClear();
+    while (ops-->0) {                 /* short intervals fill the set */
+      unsigned lo = rndAddr();
+      unsigned hi = rnd(4) ? lo + rnd(0x3000) : rndAddr();
+      const char* op = "insert";
+      const char* msg;
+      if (hi<lo) {
+        unsigned t = lo; lo = hi; hi = t;
+      }
+      if (rnd(3)) {
+        struct Model next = m;
+        modelInsert(&next, lo, hi);
+        resetResults();
+        setInsert(lo, hi);
+        if (numWords!=1) {
+          msg = "setInsert did not report a result";
+        } else if (next.n>NUMINTERVALS) {          /* no room: expect failure */
+          msg = words[0] ? "insert into full set succeeded" : checkSet(&m, 0);
+        } else {
+          m   = next;
+          msg = words[0] ? checkSet(&m, rnd(4)==0) : "insert failed with room in set";
+        }
+      } else {
+        op = "reserve";
+        modelReserve(&m, lo, hi);
+        setReserve(lo, hi);
+        msg = checkSet(&m, rnd(4)==0);
+      }
+      if (msg) {
+        failures++;
+        if (verbose) {
+          printf("intervals: %s after %s [%x-%x]\n", msg, op, lo, hi);
+          showModel(&m);
+        }
+        break;
+      }
+    }
+  }
+  return failures;
+}
+
+/* ------------------------------------------------------------------------
+ * Flexpages:
+ */
+static const char* checkFPages(unsigned lo, unsigned hi) {
+  u64 first = ((u64)lo + 0xfff) & ~(u64)0xfff;  /* whole pages in range  */
+  u64 last  = (((u64)hi + 1) & ~(u64)0xfff);    /* one past the end      */
+  u64 next  = first;
+  unsigned i;
+  resetResults();
+  fpages(lo, hi);
+  if (numPairs>=MAXRESULTS) {
+    return "too many fpages";
+  }
+  for (i=0; i<numPairs; i++) {
+    u64 flo  = pairs[i][0], fhi = pairs[i][1];
+    u64 size = (u64)1 << pairs[i][2];
+    if (pairs[i][2]<12 || pairs[i][2]>32) {
+      return "fpage size out of range";
+    } else if (flo!=next) {
+      return "fpages are not contiguous";
+    } else if ((flo & (size-1))!=0 || fhi!=flo+size-1) {
+      return "fpage is not aligned or has the wrong size";
+    } else if (pairs[i][2]<32
+            && (flo & (2*size-1))==0 && flo+2*size<=last) {
+      return "fpage could have been larger";
+    }
+    next = fhi + 1;
+  }
+  if (first<last ? next!=last : numPairs!=0) {
+    return "fpages do not cover the whole pages in the range";
+  }
+  return 0;
+}
+
+static int testFPages(int iters) {
+  static unsigned edges[][2] = {
+    { 0, 0xffffffff }, { 0, 0xfff }, { 0, 0xffe }, { 1, 0x1fff },
+    { 0xfffff000, 0xffffffff }, { 0xfffff001, 0xffffffff },
+    { 0x1000, 0x3fffff }, { 0x400000, 0x7fffffff }, { 5, 4 }
+  };
+  int failures = 0;
+  int k;
+  for (k=0; k<iters && failures<10; k++) {
+    unsigned lo, hi;
+    const char* msg;
+    if (k<(int)(sizeof(edges)/sizeof(edges[0]))) {
+      lo = edges[k][0];
+      hi = edges[k][1];
+    } else {
+      lo = rnd(2) ? rndAddr() : rndWord();
+      hi = rnd(2) ? rndAddr() : rndWord();
+      if (hi<lo && rnd(8)) {
+        unsigned t = lo; lo = hi; hi = t;
+      }
+    }
+    if (lo<=hi && (msg = checkFPages(lo, hi))) {
+      failures++;
+      if (verbose) {
+        printf("fpages: %s for [%x-%x]\n", msg, lo, hi);
+      }
+    }
+  }
+  return failures;
+}
+
+/* ------------------------------------------------------------------------
+ * Boot data cursors:  The layout of each block is a count followed by an
+ * array of entries (see mimg.llc).
+ */
+#define MAXENTRIES 200
+
+static unsigned bootHeaders[1+3*MAXENTRIES];
+static unsigned bootMMap[1+2*MAXENTRIES];
+static unsigned bootMMap64[1+4*MAXENTRIES];
+static unsigned bootData[6];
+
+static unsigned makeBootData(unsigned nh, unsigned nm, unsigned n64) {
+  unsigned i;
+  bootHeaders[0] = nh;
+  bootMMap[0]    = nm;
+  bootMMap64[0]  = n64;
+  for (i=1; i<=3*nh; i++)  bootHeaders[i] = rndWord();
+  for (i=1; i<=2*nm; i++)  bootMMap[i]    = rndWord();
+  for (i=1; i<=4*n64; i++) bootMMap64[i]  = rndWord();
+  bootData[0] = (unsigned)bootHeaders;          /* headers */
+  bootData[1] = (unsigned)bootMMap;             /* mmap    */
+  bootData[2] = 0;                              /* cmdline */
+  bootData[3] = 0;                              /* imgline */
+  bootData[4] = 0;                              /* modules */
+  bootData[5] = (unsigned)bootMMap64;           /* mmap64  */
+  return (unsigned)bootData;
+}
+
+static const char* checkCursors() {
+  unsigned nh = rnd(MAXENTRIES), nm = rnd(MAXENTRIES), n64 = rnd(MAXENTRIES/2);
+  unsigned bd = makeBootData(nh, nm, n64);
+  unsigned i;
+  resetResults();
+  walkHeaders(bd);
+  if (numPairs!=nh || numWords!=nh) {
+    return "wrong number of headers";
+  }
+  for (i=0; i<nh; i++) {
+    if (pairs[i][0]!=bootHeaders[1+3*i] || pairs[i][1]!=bootHeaders[2+3*i]
+     || words[i]!=bootHeaders[3+3*i]) {
+      return "header does not match";
+    }
+  }
+  resetResults();
+  walkMMap(bd);
+  if (numPairs!=nm) {
+    return "wrong number of memory map entries";
+  }
+  for (i=0; i<nm; i++) {
+    if (pairs[i][0]!=bootMMap[1+2*i] || pairs[i][1]!=bootMMap[2+2*i]) {
+      return "memory map entry does not match";
+    }
+  }
+  resetResults();
+  walkMMap64(bd);
+  if (numPairs!=2*n64) {
+    return "wrong number of 64 bit memory map entries";
+  }
+  for (i=0; i<2*n64; i++) {
+    if (pairs[i][0]!=bootMMap64[1+2*i] || pairs[i][1]!=bootMMap64[2+2*i]) {
+      return "64 bit memory map entry does not match";
+    }
+  }
+  return 0;
+}
+
+static int testCursors(int iters) {
+  int failures = 0;
+  int k;
+  iters = iters/10 + 1;               /* each case walks many entries */
+  for (k=0; k<iters && failures<10; k++) {
+    const char* msg = checkCursors();
+    if (msg) {
+      failures++;
+      if (verbose) {
+        printf("cursors: %s\n", msg);
+      }
+    }
+  }
+  return failures;
+}
+
+/* ------------------------------------------------------------------------
+ * Number formatting:  We check that the output reads back as the number
+ * that was printed, in the appropriate base.  (Hexadecimal output may use
+ * either case, and may have a "0x" prefix.)
+ */
+static int readsBack(unsigned n, int base, int isSigned) {
+  char* p = outBuf;
+  char* end;
+  if (outLen==0) {
+    return 0;
+  }
+  if (base==16 && p[0]=='0' && (p[1]=='x' || p[1]=='X')) {
+    p += 2;
+  }
+  if (isSigned) {
+    long long v = strtoll(p, &end, base);
+    return *end=='\0' && v==(long long)(int)n;
+  } else {
+    unsigned long long v = strtoull(p, &end, base);
+    return *end=='\0' && p[0]!='-' && v==n;
+  }
+}
+
+static int testFormat(int iters) {
+  static unsigned edges[] = { 0, 1, 9, 10, 15, 16, 0x7fffffff, 0x80000000,
+                              0xfffffffe, 0xffffffff };
+  int failures = 0;
+  int k;
+  for (k=0; k<iters && failures<10; k++) {
+    unsigned n = k<(int)(sizeof(edges)/sizeof(edges[0]))
+                 ? edges[k] : rnd(2) ? rndWord() : rnd(1000);
+    const char* msg = 0;
+    char expect[16];
+    snprintf(expect, sizeof(expect), "%u", n);
+    resetOutput(); fmtUnsigned(n);
+    if (strcmp(outBuf, expect)) msg = "putUnsigned";
+    resetOutput(); fmtSigned(n);
+    if (!msg && !readsBack(n, 10, 1)) msg = "putSigned";
+    resetOutput(); fmtHex(n);
+    if (!msg && !readsBack(n, 16, 0)) msg = "putHex";
+    resetOutput(); fmtOctal(n);
+    if (!msg && !readsBack(n, 8, 0))  msg = "putOctal";
+    resetOutput(); fmtBin(n);
+    if (!msg && !readsBack(n, 2, 0))  msg = "putBin";
+    resetOutput(); fmtSize(n);
+    if (!msg && outLen==0)            msg = "putSize";
+    if (msg) {
+      failures++;
+      if (verbose) {
+        printf("format: %s(0x%x) printed \"%s\"\n", msg, n, outBuf);
+      }
+    }
+  }
+  return failures;
+}
+
+/* ------------------------------------------------------------------------
+ * Benchmarks:
+ */
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char* name, double secs, double ops) {
+  printf("  %-36s %10.1f ns/op\n", name, secs * 1e9 / ops);
+}
+
+/* Operands are generated in advance, so that the timings do not include
+ * the cost of the random number generator.
+ */
+#define BENCHOPS 4096
+
+static void benchmarks(int reps) {
+  static unsigned lo[BENCHOPS], hi[BENCHOPS];
+  double start;
+  int i, r;
+  recording = 0;
+  for (i=0; i<BENCHOPS; i++) {
+    lo[i] = rndAddr();
+    hi[i] = lo[i] + rnd(0x100000);
+    if (hi[i]<lo[i]) {
+      hi[i] = 0xffffffff;
+    }
+  }
+  printf("Benchmarks (%d repetitions):\n", reps);
+
+  start = now();
+  for (r=0; r<reps; r++) {
+    i = r & (BENCHOPS-1);
+    if ((r & 15)==0) {
+      setClear();
+    }
+    if (r & 1) {
+      setInsert(lo[i], hi[i]);
+    } else {
+      setReserve(lo[i], hi[i]);
+    }
+  }
+  report("insertInterval/reserveInterval", now()-start, reps);
+
+  start = now();
+  for (r=0; r<reps; r++) {
+    int j;
+    setClear();
+    for (j=NUMINTERVALS-1; j>=0; j--) {         /* worst case: reversed */
+      setInsert(j*0x10000, j*0x10000+0xfff);
+    }
+    setSort();
+  }
+  report("fill and sort (8 intervals)", now()-start, reps);
+
+  start = now();
+  for (r=0; r<reps; r++) {
+    int j;
+    setClear();
+    for (j=NUMINTERVALS-1; j>=0; j--) {
+      setInsert(j*0x10000, j*0x10000+0xfff);
+    }
+  }
+  report("  fill only", now()-start, reps);
+
+  reported = 0;
+  start = now();
+  for (r=0; r<reps; r++) {
+    i = r & (BENCHOPS-1);
+    fpages(lo[i], hi[i]);
+  }
+  report("enumFPages (random ranges)", now()-start, reps);
+  report("  per fpage", now()-start, reported ? reported : 1);
+
+  start = now();
+  for (r=0; r<reps; r++) {
+    fpages(0x1000, 0xffffefff);
+  }
+  report("enumFPages [0x1000-0xffffefff]", now()-start, reps);
+
+  makeBootData(MAXENTRIES, MAXENTRIES, MAXENTRIES/2);
+  start = now();
+  for (r=0; r<reps/MAXENTRIES+1; r++) {
+    walkMMap((unsigned)bootData);
+  }
+  report("mimg cursor (per entry)", now()-start,
+         (double)(reps/MAXENTRIES+1)*MAXENTRIES);
+
+  start = now();
+  for (r=0; r<reps; r++) {
+    fmtUnsigned(lo[r & (BENCHOPS-1)]);
+  }
+  report("putUnsigned", now()-start, reps);
+
+  start = now();
+  for (r=0; r<reps; r++) {
+    fmtHex(lo[r & (BENCHOPS-1)]);
+  }
+  report("putHex", now()-start, reps);
+
+  start = now();
+  for (r=0; r<reps; r++) {
+    fmtSize(lo[r & (BENCHOPS-1)]);
+  }
+  report("putSize", now()-start, reps);
+  recording = 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Main program:
+ */
+static int check(const char* name, int (*test)(int), int iters) {
+  int failures = test(iters);
+  printf("  %-10s %s", name, failures ? "FAILED" : "passed");
+  if (failures) {
+    printf(" (%d%s failures)", failures, failures>=10 ? "+" : "");
+  }
+  printf("\n");
+  return failures!=0;
+}
+
+int main(int argc, char** argv) {
+  int iters = 10000;
+  int reps  = 100000;
+  int bench = 0;
+  int opt;
+  srandom(1);
+  while ((opt = getopt(argc, argv, "n:s:br:v"))!=-1) {
+    switch (opt) {
+      case 'n' : iters   = atoi(optarg);          break;
+      case 's' : srandom(strtoul(optarg, 0, 0)); break;
+      case 'b' : bench   = 1;                     break;
+      case 'r' : reps    = atoi(optarg);          break;
+      case 'v' : verbose = 1;                     break;
+      default  : fprintf(stderr, "usage: %s [-n cases] [-s seed] "
+                                 "[-b] [-r reps] [-v]\n", argv[0]);
+                 return 1;
+    }
+  }
+  libtest();
+  if (bench) {
+    benchmarks(reps);
+    return 0;
+  } else {
+    int failed = 0;
+    printf("Property tests (%d cases):\n", iters);
+    failed += check("intervals", testIntervals, iters);
+    failed += check("fpages",    testFPages,    iters);
+    failed += check("cursors",   testCursors,   iters);
+    failed += check("format",    testFormat,    iters);
+    return failed;
+  }
+}
+
+/* --------------------------------------------------------------------- */
@@ -31,7 +31,7 @@ typedef void (*entrypoint)();
 struct MimgHeader {
   unsigned char magic[4];
   unsigned      version;
-  entrypoint    entry;
+  unsigned      entry;      /* entrypoint address                        */
 };
 
 struct SectionHeader {
@@ -52,11 +52,13 @@ struct SectionHeader {
                             /* per header.                               */
 
 /* How many bytes (minimum) are required for a header section that has
- * len headers in it?  16 bytes for initial BootData structure;
+ * len headers in it?  20 bytes for initial BootData structure;
  *                     HDRLEN(len) bytes for the header information;
  *                     4 (or more) bytes for memory map information;
+ *                     4 (or more) bytes for data module information;
+ *                     4 (or more) bytes for 64 bit memory map information;
  *                     2 (or more) bytes for null bytes of strings.
  */
-#define BOOTLEN(len) (sizeof(struct BootData) + HDRLEN(len) + 4 + 2)
+#define BOOTLEN(len) (sizeof(struct BootData) + HDRLEN(len) + 4 + 4 + 4 + 2)
 
 /* --------------------------------------------------------------------- */
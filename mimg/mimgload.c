@@ -4,10 +4,29 @@
  * Mark P. Jones, March 2006
  */
 #include "mimg.h"
-#include "simpleio.h"
 
 #define  DEBUG(cmd)  /*cmd*/
 
+/* ------------------------------------------------------------------------
+ * Addresses:  On the real machine, a target address and a pointer to the
+ * corresponding byte of memory are the same thing.  The host-side
+ * simulator in mimgsim.c includes this file with MIMGSIM defined and its
+ * own versions of these macros, running the loader against a simulated
+ * address space.  STAT(cmd) is used to collect statistics in the simulator.
+ */
+#ifndef MIMGSIM
+#include "simpleio.h"
+#define  MEM(a)      ((void*)(a))       /* target address -> pointer     */
+#define  ADDR(p)     ((unsigned)(p))    /* pointer -> target address     */
+#define  TPTR(t, a)  ((t)(a))           /* store target address as a t   */
+#define  STAT(cmd)   /*cmd*/
+#define  ENTER(a)    (*(entrypoint)(a))()
+
+extern unsigned char _text_start[], _bss_end[];
+#define  LOADER_FIRST ((unsigned)_text_start)
+#define  LOADER_END   ((unsigned)_bss_end)
+#endif
+
 /* ------------------------------------------------------------------------
  * Multiboot data structures:
  */
@@ -25,9 +44,9 @@ struct MultibootInfo {
   unsigned                memLower;
   unsigned                memUpper;
   unsigned                bootDevice;
-  char*                   cmdline;
+  unsigned                cmdline;      /* char*                   */
   unsigned                modsCount;
-  struct MultibootModule* modsAddr;
+  unsigned                modsAddr;     /* struct MultibootModule* */
   unsigned                syms[4];
   unsigned                mmapLength;
   unsigned                mmapAddr;
@@ -36,7 +55,7 @@ struct MultibootInfo {
 struct MultibootModule {
   unsigned modStart;
   unsigned modEnd;
-  char*    modString;
+  unsigned modString;   /* char* */
   unsigned reserved;
 };
 
@@ -49,6 +68,9 @@ struct MultibootMMap {
   unsigned type;
 };
 
+#define mmapBase(m) (((unsigned long long)(m)->baseHi << 32) | (m)->baseLo)
+#define mmapLen(m)  (((unsigned long long)(m)->lenHi  << 32) | (m)->lenLo)
+
 /* ------------------------------------------------------------------------
  * Determine whether a memory map is (or can be made) available from the
  * supplied multiboot information structure.
@@ -67,20 +89,38 @@ int hasMMap() {
     defaultMMap[0].lenLo  = (mbi->memLower << 10);
     defaultMMap[1].baseLo = 0x100000;  /* 1MB */
     defaultMMap[1].lenLo  = (mbi->memUpper << 10);
-    mbi->mmapAddr         = (unsigned)(&defaultMMap);
+    mbi->mmapAddr         = ADDR(&defaultMMap);
     mbi->mmapLength       = sizeof(defaultMMap);
     return 1;
   }                                         /* No memory map!            */
   return 0;
 }
 
+/* Determine whether a given MultibootMMap structure describes a usable
+ * range of physical addresses.  Ranges may lie anywhere in the 64 bit
+ * physical address space, but we ignore empty ranges and any that would
+ * wrap around the top of the address space.
+ */
+int mmapUsable(struct MultibootMMap* mmap) {
+  unsigned long long base = mmapBase(mmap);
+  unsigned long long len  = mmapLen(mmap);
+  return (mmap->type==1) && (len!=0) && (base+len-1 >= base);
+}
+
 /* Determine whether a given MultibootMMap structure describes an
- * available range of physical (32 bit) addresses.
+ * available range of 32 bit physical addresses.  A usable range that
+ * starts below 4GB and extends above it is still available, but only
+ * the part below 4GB can be used (see mmapLast32).
  */
 int mmapAvailable(struct MultibootMMap* mmap) {
-  return (mmap->type=1)
-      && (mmap->baseHi==0) && (mmap->lenHi==0)
-      && (mmap->baseLo+mmap->lenLo-1 >= mmap->baseLo);
+  return mmapUsable(mmap) && (mmap->baseHi==0);
+}
+
+/* Find the last address in an available range that is below 4GB.
+ */
+unsigned mmapLast32(struct MultibootMMap* mmap) {
+  unsigned long long last = mmapBase(mmap) + mmapLen(mmap) - 1;
+  return (last>>32) ? 0xffffffff : (unsigned)last;
 }
 
 /* Determine whether a given range of addresses fits in the memory map.
@@ -89,10 +129,10 @@ int fitsInMemory(unsigned first, unsigned last) {
   unsigned m = mbi->mmapAddr;
   unsigned l = mbi->mmapAddr + mbi->mmapLength;
   while (m < l) {
-    struct MultibootMMap* mmap = (struct MultibootMMap*)m;
-    if (mmap->baseLo<=first
-        && last<mmap->baseLo+mmap->lenLo
-        && mmapAvailable(mmap)) {
+    struct MultibootMMap* mmap = (struct MultibootMMap*)MEM(m);
+    if (mmapAvailable(mmap)
+        && mmap->baseLo<=first
+        && last<=mmapLast32(mmap)) {
       return 1;
     }
     m += (mmap->size + sizeof(mmap->size));
@@ -100,21 +140,23 @@ int fitsInMemory(unsigned first, unsigned last) {
   return 0;
 }
 
-/* Copy memory map details into a BOOTDATA section.
+/* Copy memory map details into a BOOTDATA section.  This version of the
+ * memory map only includes memory below 4GB, so it can be used by any
+ * kernel, with or without PAE paging.
  */
 unsigned copyMMap(unsigned first, unsigned last) {
   unsigned num = ((last-first)-3) / 8;
   if (num>=0) { /* We must have room at least for the count */
     unsigned  m  = mbi->mmapAddr;
     unsigned  l  = mbi->mmapAddr + mbi->mmapLength;
-    unsigned* ns = (unsigned*)first;
+    unsigned* ns = (unsigned*)MEM(first);
     unsigned  i  = 0;
     while (i<num && m<l) {
-      struct MultibootMMap* mmap = (struct MultibootMMap*)m;
+      struct MultibootMMap* mmap = (struct MultibootMMap*)MEM(m);
       if (mmapAvailable(mmap)) {
         i++;
         ns[2*i-1] = mmap->baseLo;
-        ns[2*i]   = mmap->baseLo + mmap->lenLo - 1;
+        ns[2*i]   = mmapLast32(mmap);
         DEBUG(printf("memory map[%d]: %x-%x\n", i, ns[2*i-1], ns[2*i]));
       }
       m += (mmap->size + sizeof(mmap->size));
@@ -125,6 +167,86 @@ unsigned copyMMap(unsigned first, unsigned last) {
   return first;
 }
 
+/* Copy the full 64 bit memory map into a BOOTDATA section, for kernels
+ * that use PAE paging to reach memory above 4GB.  Each entry is written
+ * as four words: the low and high words of the first address, followed
+ * by the low and high words of the last address.
+ */
+unsigned copyMMap64(unsigned first, unsigned last) {
+  unsigned num = ((last-first)-3) / 16;
+  if (num>=0) { /* We must have room at least for the count */
+    unsigned  m  = mbi->mmapAddr;
+    unsigned  l  = mbi->mmapAddr + mbi->mmapLength;
+    unsigned* ns = (unsigned*)MEM(first);
+    unsigned  i  = 0;
+    while (i<num && m<l) {
+      struct MultibootMMap* mmap = (struct MultibootMMap*)MEM(m);
+      if (mmapUsable(mmap)) {
+        unsigned long long end = mmapBase(mmap) + mmapLen(mmap) - 1;
+        ns[4*i+1] = mmap->baseLo;
+        ns[4*i+2] = mmap->baseHi;
+        ns[4*i+3] = (unsigned)end;
+        ns[4*i+4] = (unsigned)(end>>32);
+        DEBUG(printf("memory map64[%d]: %x:%x-%x:%x\n", i+1,
+                     ns[4*i+2], ns[4*i+1], ns[4*i+4], ns[4*i+3]));
+        i++;
+      }
+      m += (mmap->size + sizeof(mmap->size));
+    }
+    ns[0]  = i;         /* write the count */
+    first += 4 + 16*i;  /* 4 bytes for count + 16 bytes for each entry */
+  }
+  return first;
+}
+
+/* ------------------------------------------------------------------------
+ * Data modules:  Any modules after the first are passed on to the kernel
+ * in place, so the image must not load anything on top of them.
+ */
+
+/* Determine whether a given range of addresses overlaps a data module.
+ */
+int overlapsModule(unsigned first, unsigned last) {
+  struct MultibootModule* mods = (struct MultibootModule*)MEM(mbi->modsAddr);
+  unsigned i;
+  for (i=1; i<mbi->modsCount; i++) {
+    if (mods[i].modEnd>mods[i].modStart
+     && first<mods[i].modEnd && last>=mods[i].modStart) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Copy data module details into a BOOTDATA section.  Empty modules
+ * are skipped, as in overlapsModule, because they have no valid last
+ * address.  As with the memory map, only as many modules are listed
+ * as will fit in the space that is left in the section; any others
+ * are dropped (with a warning), so an image that expects data modules
+ * must leave enough room for them in its bootdata section.
+ */
+unsigned copyModules(unsigned first, unsigned last) {
+  unsigned  num = ((last-first)-3) / 8;
+  struct MultibootModule* mods = (struct MultibootModule*)MEM(mbi->modsAddr);
+  unsigned* ns  = (unsigned*)MEM(first);
+  unsigned  i   = 0;
+  unsigned  j;
+  for (j=1; j<mbi->modsCount; j++) {
+    if (mods[j].modEnd>mods[j].modStart) {
+      if (i>=num) {
+        printf("Warning: no room in boot data for module %d\n", j);
+      } else {
+        i++;
+        ns[2*i-1] = mods[j].modStart;
+        ns[2*i]   = mods[j].modEnd - 1;
+        DEBUG(printf("module[%d]: %x-%x\n", j, ns[2*i-1], ns[2*i]));
+      }
+    }
+  }
+  ns[0] = i;          /* write the count */
+  return first + 4 + 8*i;
+}
+
 /* ------------------------------------------------------------------------
  * Memory image loading:
  */
@@ -132,7 +254,7 @@ unsigned copyMMap(unsigned first, unsigned last) {
 /* Calculate the address of the first byte after the current section.
  */
 unsigned nextSection(struct SectionHeader* curr) {
-  unsigned next = (unsigned)curr + sizeof(struct SectionHeader);
+  unsigned next = ADDR(curr) + sizeof(struct SectionHeader);
   if (curr->type==DATA) {
     next += 1 + (curr->last - curr->first);
   } else if (curr->type==BOOTDATA) {
@@ -146,24 +268,24 @@ unsigned nextSection(struct SectionHeader* curr) {
  * string indicates that the image is valid.
  */
 char* validImage(unsigned start, unsigned finish) {
-  extern unsigned char _text_start[], _bss_end[];
   if (start>finish) {
     return "image start exceeds image finish";
   } else if (1+(finish-start)<sizeof(struct MimgHeader)) {
     return "image is too small";
   } else {
-    struct MimgHeader* mimg = (struct MimgHeader*)start;
+    struct MimgHeader* mimg = (struct MimgHeader*)MEM(start);
     unsigned allowed        = 0;
     unsigned foundEntry     = 0;
     if (mimg->magic[0]!='m' || mimg->magic[1]!='i'
      || mimg->magic[2]!='m' || mimg->magic[3]!='g') {
       return "image has incorrect magic number";
-    } else if ((unsigned)mimg->entry==NOENTRY) {
+    } else if (mimg->entry==NOENTRY) {
       return "image does not specify an entry point";
     }
     start += sizeof(struct MimgHeader);  /* skip magic number */
     while (start<=finish) {
-      struct SectionHeader* curr = (struct SectionHeader*)start;
+      struct SectionHeader* curr = (struct SectionHeader*)MEM(start);
+      STAT(simStats.validated++);
       if (start+sizeof(struct SectionHeader)>finish+1) {
         return "incomplete section header";
       } else if (curr->first>curr->last) {
@@ -172,9 +294,11 @@ char* validImage(unsigned start, unsigned finish) {
         return "sections overlap or are not sorted";
       } else if (!fitsInMemory(curr->first, curr->last)) {
         return "section does not fit within memory map";
-      } else if (!(curr->last  <  (unsigned)_text_start
-                || curr->first >= (unsigned)_bss_end)) {
+      } else if (!(curr->last  <  LOADER_FIRST
+                || curr->first >= LOADER_END)) {
         return "section overlaps with loader";
+      } else if (overlapsModule(curr->first, curr->last)) {
+        return "section overlaps with data module";
       } else if (curr->type==BOOTDATA 
               && (curr->first+BOOTLEN(*(unsigned*)(curr+1)))>curr->last+1) {
         return "bootdata section is too small";
@@ -187,8 +311,8 @@ char* validImage(unsigned start, unsigned finish) {
           return "section wraps around address space";
         }
         if (curr->type == DATA
-         && curr->first <= (unsigned)mimg->entry
-         && curr->last  >= (unsigned)mimg->entry) {
+         && curr->first <= mimg->entry
+         && curr->last  >= mimg->entry) {
           foundEntry = 1;
         }
         start   = next;
@@ -200,15 +324,68 @@ char* validImage(unsigned start, unsigned finish) {
 }
 
 /* Copy len bytes from one location to another, allowing for the
- * possibility that the two regions overlap.
+ * possibility that the two regions overlap.  Most copies move data
+ * to lower addresses, so they can run front to back, and this is
+ * done by the copyForward routine that selectCopy chooses at boot
+ * time: a single rep movsb on processors with enhanced rep movsb
+ * (ERMS), rep movsl (with rep movsb for the last few bytes) on other
+ * processors, and a simple loop in the simulator.  Overlapping copies
+ * to higher addresses are rare, and use a loop that runs back to front.
  */
+typedef void (*CopyFn)(unsigned char* dst, unsigned char* src, unsigned len);
+
+void copyBytes(unsigned char* dst, unsigned char* src, unsigned len) {
+  for (; len>0; len--) {
+    *dst++ = *src++;
+  }
+}
+
+#ifndef MIMGSIM
+void copyMovsb(unsigned char* dst, unsigned char* src, unsigned len) {
+  asm volatile("cld; rep movsb"
+               : "+D"(dst), "+S"(src), "+c"(len) : : "memory");
+}
+
+void copyMovsl(unsigned char* dst, unsigned char* src, unsigned len) {
+  unsigned words = len >> 2;
+  unsigned bytes = len & 3;
+  asm volatile("cld; rep movsl; movl %3, %%ecx; rep movsb"
+               : "+D"(dst), "+S"(src), "+c"(words) : "r"(bytes) : "memory");
+}
+
+#define CPUID_ERMS (1 << 9)          /* cpuid.07h:ebx, enhanced rep movsb */
+
+void cpuid(unsigned leaf, unsigned regs[4]) {
+  asm volatile("cpuid"
+               : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+               : "a"(leaf), "c"(0));
+}
+#endif
+
+CopyFn copyForward = copyBytes;
+
+void selectCopy() {
+#ifndef MIMGSIM
+  unsigned regs[4];
+  cpuid(0, regs);                    /* eax = highest standard leaf      */
+  copyForward = copyMovsl;
+  if (regs[0]>=7) {
+    cpuid(7, regs);
+    if (regs[1] & CPUID_ERMS) {
+      copyForward = copyMovsb;
+    }
+  }
+  DEBUG(printf("Using %s for copies\n",
+               copyForward==copyMovsb ? "rep movsb" : "rep movsl"));
+#endif
+}
+
 void smartcopy(unsigned to, unsigned from, unsigned len) {
-  unsigned char* dst = (unsigned char*)to;
-  unsigned char* src = (unsigned char*)from;
+  unsigned char* dst = (unsigned char*)MEM(to);
+  unsigned char* src = (unsigned char*)MEM(from);
+  STAT(simStats.copied += len);
   if (to<from) {        /* load data front to back */
-    for (; len>0; len--) {
-      *dst++ = *src++;
-    }
+    copyForward(dst, src, len);
   } else if (to>from) { /* load data back to front */
     for (src+=len, dst+=len; len>0; len--) {
       *--dst = *--src;
@@ -222,7 +399,7 @@ void smartcopy(unsigned to, unsigned from, unsigned len) {
  */
 unsigned copyStr(char* s, unsigned first, unsigned last) {
   if (first<=last) {
-    char* p = (char*)first;
+    char* p = (char*)MEM(first);
     for (; first<last && *s; first++) {
       *p++ = *s++;
     }
@@ -237,12 +414,14 @@ unsigned copyStr(char* s, unsigned first, unsigned last) {
  * portion of the section, or by writing boot data into it.
  */
 void loadSection(struct SectionHeader* sec) {
-  unsigned data = (unsigned)sec + sizeof(struct SectionHeader);
+  unsigned data = ADDR(sec) + sizeof(struct SectionHeader);
   unsigned len  = 1 + (sec->last - sec->first);
-  DEBUG(printf("section [%x-%x] loads to ", sec, nextSection(sec)));
+  STAT(simStats.loaded++);
+  DEBUG(printf("section [%x-%x] loads to ", ADDR(sec), nextSection(sec)));
   DEBUG(printf("[%x-%x]\n", sec->first, sec->last));
   if (sec->type==ZERO) {
-    unsigned char* dst = (unsigned char*)sec->first;
+    unsigned char* dst = (unsigned char*)MEM(sec->first);
+    STAT(simStats.zeroed += len);
     for (; len>0; len--) {
       *dst++ = '\0';
     }
@@ -252,19 +431,26 @@ void loadSection(struct SectionHeader* sec) {
     /* first and last might be overwritten during the smartcopy step! */
     unsigned first      = sec->first;
     unsigned last       = sec->last;
-    struct BootData* bd = (struct BootData*)first;
-    unsigned req        = HDRLEN(*(unsigned*)data);
+    struct BootData* bd = (struct BootData*)MEM(first);
+    unsigned req        = HDRLEN(*(unsigned*)MEM(data));
     unsigned hdrs       = first + sizeof(struct BootData);
-    char*    cmdline    = (mbi->flags & MBI_CMD_VALID) ? mbi->cmdline : "";
-    char*    imgline    = mbi->modsAddr[0].modString;
+    struct MultibootModule* mods
+                        = (struct MultibootModule*)MEM(mbi->modsAddr);
+    char*    cmdline    = (mbi->flags & MBI_CMD_VALID)
+                        ? (char*)MEM(mbi->cmdline) : "";
+    char*    imgline    = (char*)MEM(mods[0].modString);
     unsigned nxt        = hdrs + req;
     smartcopy(hdrs, data, req);
-    bd->headers = (unsigned*)hdrs;
-    bd->mmap    = (unsigned*)nxt;
-    nxt         = copyMMap(nxt, last-2);
-    bd->cmdline = (char*)nxt;
+    bd->headers = TPTR(unsigned*, hdrs);
+    bd->mmap    = TPTR(unsigned*, nxt);
+    nxt         = copyMMap(nxt, last-10);
+    bd->modules = TPTR(unsigned*, nxt);
+    nxt         = copyModules(nxt, last-6);
+    bd->mmap64  = TPTR(unsigned*, nxt);
+    nxt         = copyMMap64(nxt, last-2);
+    bd->cmdline = TPTR(char*, nxt);
     nxt         = copyStr(cmdline, nxt, last-1);
-    bd->imgline = (char*)nxt;
+    bd->imgline = TPTR(char*, nxt);
     copyStr(imgline, nxt, last);
   }
 }
@@ -276,25 +462,30 @@ void loadSection(struct SectionHeader* sec) {
 void loadImage(unsigned start, unsigned finish) {
   start += sizeof(struct MimgHeader);  /* skip magic number */
   while (start <= finish) {
-    struct SectionHeader* prev = 0;
-    struct SectionHeader* curr = (struct SectionHeader*)start;
+    unsigned prev              = 0;
+    unsigned reach             = 0;  /* last byte written by skipped secs */
+    struct SectionHeader* curr = (struct SectionHeader*)MEM(start);
     unsigned next              = nextSection(curr);
 
     /* Skip sections that cannot be loaded */
     while (next<=finish         /* This is not the last section and it   */
-        && curr->last>=next     /* loads over later sections in the mimg */
-        && curr->first<=finish) {
-      curr->prev = (unsigned)prev;
-      prev       = curr;
-      curr       = (struct SectionHeader*)next;
+        && ((curr->last>=next   /* loads over later sections in the mimg */
+             && curr->first<=finish)
+         || (prev && reach>=next))) {  /* or a skipped section does      */
+      if (curr->last>reach) {
+        reach = curr->last;
+      }
+      curr->prev = prev;
+      prev       = ADDR(curr);
+      curr       = (struct SectionHeader*)MEM(next);
       next       = nextSection(curr);
     }
 
     /* Load current section and any that came before it. */
     loadSection(curr);
     while (prev) {
-      curr = prev;
-      prev = (struct SectionHeader*)curr->prev;
+      curr = (struct SectionHeader*)MEM(prev);
+      prev = curr->prev;
       loadSection(curr);
     }
 
@@ -317,20 +508,20 @@ void mimgload() {
     printf("Cannot locate memory image.\n");
   } else if (mbi->modsCount<1) {
     printf("No boot modules specified.\n");
-  } else if (mbi->modsCount>1) {
-    printf("Multiple boot modules specified.\n");
   } else {
-    unsigned start  = mbi->modsAddr[0].modStart;
-    unsigned finish = mbi->modsAddr[0].modEnd - 1;
+    struct MultibootModule* mods = (struct MultibootModule*)MEM(mbi->modsAddr);
+    unsigned start  = mods[0].modStart;
+    unsigned finish = mods[0].modEnd - 1;
     char*    msg    = validImage(start, finish);
     DEBUG(printf("Boot image located at [%x-%x]\n", start, finish));
     if (msg) {
       printf("Invalid image: %s\n", msg);
     } else {
-      entrypoint entry = ((struct MimgHeader*)start)->entry;
+      unsigned entry = ((struct MimgHeader*)MEM(start))->entry;
+      selectCopy();
       loadImage(start, finish);
       DEBUG(printf("Now branch to address 0x%x\n", entry));
-      (*entry)();
+      ENTER(entry);
     }
   }
   printf("Boot attempt failed; system halting.\n");
@@ -10,51 +10,197 @@
 #include <fcntl.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <pthread.h>
+#include <zlib.h>
 #include "mimg.h"
 
 #define ABORT exit(1)
 
 /* ========================================================================
  * Support code for writing a (binary) output file:
+ *
+ * Output is collected in blocks of BINOUTLEN bytes.  If the name of the
+ * output file ends in ".gz", then the image is written as a single gzip
+ * stream, without an intermediate uncompressed file.  Each batch of
+ * blocks is compressed in parallel, one thread per block, as a sequence
+ * of raw deflate streams that end on a byte boundary (using a sync
+ * flush) so that they can simply be concatenated.  The dictionary for
+ * each block is primed with the last 32KB of the block before it, so
+ * the compression ratio is almost the same as for a single-threaded
+ * compressor.  The CRCs for the individual blocks are combined to give
+ * the CRC for the whole file in the gzip trailer.
  */
-#define BINOUTLEN  1024
-static unsigned char binoutbuf[BINOUTLEN];
-static unsigned binoutpos;
-static unsigned binoutlen;
+#define BINOUTLEN  (128*1024)   /* Size of each output block             */
+#define MAXTHREADS 16           /* Maximum number of blocks in a batch   */
+#define DICTLEN    32768        /* Size of deflate window                */
+
+struct Block {
+  unsigned char  buf[BINOUTLEN];/* Uncompressed data for this block      */
+  unsigned       len;
+  unsigned char* dict;          /* Preceding data, used as a dictionary  */
+  unsigned       dictlen;
+  unsigned char* out;           /* Compressed data for this block        */
+  unsigned       outlen;
+  unsigned long  crc;           /* CRC of the uncompressed data          */
+  int            last;          /* Nonzero for the last block in file    */
+  pthread_t      thread;
+};
+
+static struct Block* binoutblk;  /* Blocks in the current batch          */
+static unsigned binoutnum;       /* Number of blocks in a batch          */
+static unsigned binoutcur;       /* Index of block being filled          */
+static unsigned binoutlen;       /* Total uncompressed bytes             */
+static unsigned binoutzlen;      /* Total compressed bytes               */
+static unsigned long binoutcrc;  /* CRC of all data flushed so far       */
+static unsigned char binoutdict[DICTLEN];
+static unsigned binoutdictlen;
+static int binoutgz;
 static int binoutfd;
 
+void binoutWrite(unsigned char* buf, unsigned len) {
+  if (write(binoutfd, buf, len)!=len) {
+    printf("Unable to write to output file\n");
+    ABORT;
+  }
+}
+
 void binoutOpen(char* filename) {
-  binoutpos = 0;
-  binoutlen = 0;
-  binoutfd  = open(filename, O_CREAT|O_TRUNC|O_WRONLY, 0666);
+  unsigned n = strlen(filename);
+  binoutgz   = n>3 && strcmp(filename+n-3, ".gz")==0;
+  binoutnum  = 1;
+  if (binoutgz) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    binoutnum = cpus<1 ? 1 : cpus>MAXTHREADS ? MAXTHREADS : cpus;
+  }
+  binoutblk = (struct Block*)calloc(binoutnum, sizeof(struct Block));
+  if (!binoutblk) {
+    printf("Could not allocate output buffers\n");
+    ABORT;
+  }
+  binoutcur     = 0;
+  binoutlen     = 0;
+  binoutzlen    = 0;
+  binoutcrc     = crc32(0L, Z_NULL, 0);
+  binoutdictlen = 0;
+  binoutfd      = open(filename, O_CREAT|O_TRUNC|O_WRONLY, 0666);
   if (binoutfd<0) {
     printf("Unable to create output file \"%s\"\n", filename);
     ABORT;
   }
+  if (binoutgz) {                /* gzip header: deflate, no name/time, */
+    static unsigned char hdr[10] /* maximum compression, Unix           */
+      = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 2, 3 };
+    binoutWrite(hdr, sizeof(hdr));
+    binoutzlen += sizeof(hdr);
+  }
 }
 
-void binoutFlush() {
-  if (write(binoutfd, binoutbuf, binoutpos)!=binoutpos) {
-    printf("Unable to write to output file\n");
-    ABORT;
+void* deflateBlock(void* arg) {  /* Compress a single block (per thread) */
+  struct Block* blk = (struct Block*)arg;
+  unsigned size     = BINOUTLEN + BINOUTLEN/8 + 64;
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  blk->crc    = crc32(crc32(0L, Z_NULL, 0), blk->buf, blk->len);
+  blk->outlen = 0;
+  if (deflateInit2(&strm, 9, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY)!=Z_OK
+   || (blk->dictlen>0
+       && deflateSetDictionary(&strm, blk->dict, blk->dictlen)!=Z_OK)
+   || !(blk->out || (blk->out = (unsigned char*)malloc(size)))) {
+    return blk;                  /* outlen==0 signals failure            */
+  }
+  strm.next_in   = blk->buf;
+  strm.avail_in  = blk->len;
+  strm.next_out  = blk->out;
+  strm.avail_out = size;
+  if (deflate(&strm, blk->last ? Z_FINISH : Z_SYNC_FLUSH)
+        == (blk->last ? Z_STREAM_END : Z_OK) && strm.avail_in==0) {
+    blk->outlen = size - strm.avail_out;
+  }
+  deflateEnd(&strm);
+  return blk;
+}
+
+void binoutFlush(int last) {     /* Write out the current batch          */
+  unsigned n = binoutcur + 1;
+  unsigned i;
+  if (!binoutgz) {
+    binoutWrite(binoutblk[0].buf, binoutblk[0].len);
+    binoutlen += binoutblk[0].len;
+    binoutblk[0].len = 0;
+    return;
+  }
+  for (i=0; i<n; i++) {
+    struct Block* blk = binoutblk + i;
+    blk->dict    = i==0 ? binoutdict : binoutblk[i-1].buf+BINOUTLEN-DICTLEN;
+    blk->dictlen = i==0 ? binoutdictlen : DICTLEN;
+    blk->last    = last && i+1==n;
+    if (i+1<n && pthread_create(&blk->thread, NULL, deflateBlock, blk)!=0) {
+      printf("Unable to start compression thread\n");
+      ABORT;
+    }
+  }
+  deflateBlock(binoutblk + n - 1);
+  for (i=0; i<n; i++) {
+    struct Block* blk = binoutblk + i;
+    if (i+1<n) {
+      pthread_join(blk->thread, NULL);
+    }
+    if (blk->outlen==0) {
+      printf("Unable to compress output\n");
+      ABORT;
+    }
+    binoutWrite(blk->out, blk->outlen);
+    binoutcrc   = crc32_combine(binoutcrc, blk->crc, blk->len);
+    binoutlen  += blk->len;
+    binoutzlen += blk->outlen;
+  }
+  if (!last) {                   /* Every block is full unless last     */
+    binoutdictlen = DICTLEN;
+    memcpy(binoutdict, binoutblk[n-1].buf+BINOUTLEN-DICTLEN, DICTLEN);
   }
-  binoutlen += binoutpos;
-  binoutpos  = 0;
+  for (i=0; i<n; i++) {
+    binoutblk[i].len = 0;
+  }
+  binoutcur = 0;
 }
 
 void binoutClose() {
-  if (binoutpos>0) {
-    binoutFlush();
+  unsigned i;
+  binoutFlush(1);
+  if (binoutgz) {                /* gzip trailer: CRC32 and input size   */
+    unsigned char trl[8];
+    for (i=0; i<4; i++) {
+      trl[i]   = (binoutcrc >> (8*i)) & 0xff;
+      trl[4+i] = (binoutlen >> (8*i)) & 0xff;
+    }
+    binoutWrite(trl, sizeof(trl));
+    binoutzlen += sizeof(trl);
   }
   close(binoutfd);
-  printf("Wrote %d bytes\n", binoutlen);
+  if (binoutgz) {
+    printf("Wrote %u bytes (%u compressed, %u thread%s)\n",
+           binoutlen, binoutzlen, binoutnum, binoutnum==1 ? "" : "s");
+  } else {
+    printf("Wrote %u bytes\n", binoutlen);
+  }
+  for (i=0; i<binoutnum; i++) {
+    free(binoutblk[i].out);
+  }
+  free(binoutblk);
 }
 
 void outbyte(unsigned char b) {  /* Output a single bye                 */
-  binoutbuf[binoutpos++] = (b & 0xff);
-  if (binoutpos>=BINOUTLEN) {
-    binoutFlush();
+  struct Block* blk = binoutblk + binoutcur;
+  if (blk->len>=BINOUTLEN) {     /* Current block is full               */
+    if (binoutcur+1<binoutnum) {
+      blk++;
+      binoutcur++;
+    } else {
+      binoutFlush(0);
+      blk = binoutblk;
+    }
   }
+  blk->buf[blk->len++] = (b & 0xff);
 }
 
 void outword(unsigned w) {       /* Output word in little endian format */
@@ -203,7 +349,7 @@ struct FileImage* readFile(char* filename) {
 /* ========================================================================
  * ELF file and program headers:
  */
-typedef unsigned long  ElfWord, ElfAddr, ElfOff;
+typedef unsigned int   ElfWord, ElfAddr, ElfOff;
 typedef unsigned short ElfHalf;
 
 /* Defines the layout of the header at the beginning of an ELF file.
@@ -566,6 +712,127 @@ void insertElf(struct MemImage* mimg, char* filename, int load) {
   } /* end found valid ELF file */
 }
 
+/* ========================================================================
+ * Snapshots:  A kernel that uses libs-lc/snapshot.llc can print a copy of
+ * its memory on the serial port once it has finished initializing, in
+ * the following form:
+ *
+ *   SNAPSHOT BEGIN
+ *   E entry            entry point for the resumed kernel
+ *   R first last       a range of memory, followed by its contents as
+ *   D word word ...    lines of (little endian) words, starting at the
+ *   ...                word that contains first
+ *   SNAPSHOT END
+ *
+ * with all numbers in hex.  The contents of each range are loaded into
+ * the image, with long runs of zero bytes (such as the kernel's bss)
+ * stored as ZERO sections, and a single header covers all of the ranges.
+ */
+#define SNAPZEROS 4096      /* Shortest run of zeros to use a ZERO section */
+
+/* Insert the contents of a single range, splitting it into DATA and ZERO
+ * sections.
+ */
+void insertRange(struct MemImage* mimg, struct FileImage* img,
+                 unsigned first) {
+  unsigned char* p   = (unsigned char*)img->contents;
+  unsigned       len = img->length;
+  unsigned       i   = 0;
+  while (i<len) {
+    unsigned j = i;
+    while (j<len && p[j]==0) {
+      j++;
+    }
+    if (j-i>=SNAPZEROS || j==len) {     /* Zeros, up to the next data    */
+      insert(mimg, section(first+i, first+j-1, NULL, ZERO));
+    } else {                            /* Data, up to the next zeros    */
+      while (j<len) {
+        unsigned z = j;
+        while (z<len && p[z]==0) {
+          z++;
+        }
+        if (z-j>=SNAPZEROS || z==len) {
+          break;
+        }
+        j = z+1;
+      }
+      insert(mimg, section(first+i, first+j-1, img, i));
+    }
+    i = j;
+  }
+}
+
+void insertSnapshot(struct MemImage* mimg, char* filename) {
+  FILE*             f       = fopen(filename, "r");
+  struct FileImage* img     = NULL;
+  unsigned          entry   = NOENTRY;
+  unsigned          first   = 0;
+  unsigned          next    = 0;  /* address of the next word of data   */
+  unsigned          minAddr = 0xffffffff;
+  unsigned          maxAddr = 0;
+  int               state   = 0;  /* 0: before, 1: inside, 2: after     */
+  char              line[256];
+
+  if (f==NULL) {
+    printf("Could not open snapshot file \"%s\"\n", filename);
+    ABORT;
+  }
+  while (state<2 && fgets(line, sizeof(line), f)) {
+    unsigned a, b;
+    char*    s = line;
+    if (strncmp(line, "SNAPSHOT BEGIN", 14)==0) {
+      state = 1;
+    } else if (state==0) {
+      continue;
+    } else if (strncmp(line, "SNAPSHOT END", 12)==0) {
+      state = 2;
+    } else if (sscanf(line, "E %x", &a)==1) {
+      entry = a;
+    } else if (sscanf(line, "R %x %x", &a, &b)==2 && a<=b) {
+      if (img) {
+        insertRange(mimg, img, first);
+      }
+      if (!(img=(struct FileImage*)malloc(sizeof(struct FileImage)))
+       || !(img->contents=calloc(1+(b-a), 1))) {
+        printf("Could not allocate buffer for snapshot range\n");
+        ABORT;
+      }
+      img->filename = filename;
+      img->length   = 1+(b-a);
+      first         = a;
+      next          = a & ~3;
+      if (a<minAddr) {
+        minAddr = a;
+      }
+      if (b>maxAddr) {
+        maxAddr = b;
+      }
+    } else if (line[0]=='D' && img) {
+      int n;
+      s++;
+      while (sscanf(s, "%x%n", &a, &n)==1) {
+        int i;
+        for (i=0; i<4; i++, next++) {
+          if (next>=first && next-first<img->length) {
+            ((unsigned char*)img->contents)[next-first] = a >> (8*i);
+          }
+        }
+        s += n;
+      }
+    } else if (line[0]!='\n' && line[0]!='\r') {
+      printf("Unrecognized line in snapshot \"%s\": %s", filename, line);
+      ABORT;
+    }
+  }
+  fclose(f);
+  if (state!=2 || !img) {
+    printf("No complete snapshot found in \"%s\"\n", filename);
+    ABORT;
+  }
+  insertRange(mimg, img, first);
+  mimg->hdrs = addHeader(mimg->hdrs, minAddr, maxAddr, entry);
+}
+
 /* ========================================================================
  * Parse arguments:
  */
@@ -657,6 +924,8 @@ void parseArg(struct MemImage* mimg, char* arg) {
     }
   } else if (strncmp(arg, "noload:", 7)==0) {
     insertElf(mimg, s+1, 0);      /* noload:file; ELF reserve  */
+  } else if (strncmp(arg, "snapshot:", 9)==0) {
+    insertSnapshot(mimg, s+1);    /* snapshot:file; saved kernel */
   } else {                        /* keyword:addr-addr; special */
     unsigned first, last;
     s     = readAddr(arg, s+1);
@@ -698,6 +967,7 @@ int main(int argc, char* argv[]) {
     printf("where each arg is one of the following:\n");
     printf("  file               load ELF file\n");
     printf("  noload:file        reserve ELF file\n");
+    printf("  snapshot:file      load kernel snapshot from serial log\n");
     printf("  zero:addr-addr     zero all addresses in specified range\n");
     printf("  bootdata:addr-addr store bootdata in specified range\n");
     printf("  reserved:addr-addr reserve all addresses in specified range\n");
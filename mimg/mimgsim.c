@@ -0,0 +1,530 @@
+/* ------------------------------------------------------------------------
+ * mimgsim.c:  host-side simulator for the mimgload memory image loader
+ *
+ * This program compiles the loader code in mimgload.c for a Linux host,
+ * running it against a simulated 32 bit physical address space (a 4GB
+ * sparse mapping, so that only the pages that are actually touched use
+ * any real memory) and a synthetic multiboot information structure.
+ * This makes it possible to test and benchmark changes to the loader
+ * without booting QEMU, and to fuzz the validation code.
+ *
+ * Usage:  mimgsim [options] [image ...]
+ *
+ *   Each image (an uncompressed file produced by mimgmake) is copied to
+ *   the module address, validated, loaded, and then checked to make sure
+ *   that every section holds the expected contents.  Statistics for each
+ *   image are printed after loading.
+ *
+ *   -m mb      size of simulated memory, in MB (default 32)
+ *   -H mb      also describe a region of memory above 4GB, in MB, and
+ *              check that it only appears in the 64 bit memory map
+ *   -a addr    address at which the image is placed (default 0x300000)
+ *   -d addr    also pass a 64KB data module at the given address, and
+ *              check that it is not disturbed by loading
+ *   -r n       number of times to load each image, for timing (default 1)
+ *   -f n       run n fuzzing iterations, mutating each given image or, if
+ *              none are given, randomly generated images
+ *   -s seed    random seed for fuzzing (default 1)
+ *   -v         print the loader's own output (from mimgload)
+ *
+ * If the loader crashes while fuzzing, the offending image is written to
+ * a file called mimgsim-crash.img so that it can be replayed; the first
+ * image that loads incorrectly is written to mimgsim-fail.img.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* ------------------------------------------------------------------------
+ * Simulated address space:
+ */
+#define MIMGSIM
+
+static unsigned char* simMem;         /* Base of simulated memory        */
+
+#define MEM(a)      ((void*)(simMem + (unsigned)(a)))
+#define ADDR(p)     ((unsigned)((unsigned char*)(p) - simMem))
+#define TPTR(t, a)  (a)
+#define STAT(cmd)   cmd
+#define ENTER(a)    (simEntered = (a))
+
+#define LOADER_FIRST 0x200000         /* Address range of mimgload, as   */
+#define LOADER_END   0x210000         /* set in mimgload.ld              */
+
+static struct {
+  unsigned long long validated;       /* section headers validated       */
+  unsigned long long loaded;          /* sections loaded                 */
+  unsigned long long copied;          /* bytes moved by smartcopy        */
+  unsigned long long zeroed;          /* bytes cleared in ZERO sections  */
+} simStats;
+
+static unsigned simEntered;           /* Entry point reached by mimgload */
+static int      simVerbose = 0;
+
+/* The loader's output functions are replaced by versions that can be
+ * turned on or off from the command line:
+ */
+static void cls() {
+}
+
+static void simPrintf(const char* fmt, ...) {
+  if (simVerbose) {
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+  }
+}
+
+#define printf simPrintf
+#include "mimgload.c"
+#undef  printf
+
+struct MultibootInfo* mbi;
+unsigned              mbi_magic;
+
+/* ------------------------------------------------------------------------
+ * Synthetic multiboot information:  We place the multiboot structures
+ * in low memory, just below the EBDA, describing a machine with a
+ * standard 640KB of base memory and the requested amount of high memory.
+ */
+#define MBI_ADDR   0x9000
+#define MODS_ADDR  0x9100
+#define MMAP_ADDR  0x9200
+#define STR_ADDR   0x9400
+
+static unsigned memSize    = 32;      /* MB of simulated memory          */
+static unsigned moduleAddr = 0x300000;
+static unsigned dataAddr   = 0;       /* Address of data module, if any  */
+static unsigned highSize   = 0;       /* MB of memory above 4GB, if any  */
+
+#define DATA_LEN     0x10000          /* Length of the data module       */
+#define DATA_BYTE(i) ((unsigned char)((i) * 7 + 0x5a))
+
+static void initMBI(unsigned start, unsigned len) {
+  struct MultibootModule* mods = (struct MultibootModule*)MEM(MODS_ADDR);
+  struct MultibootMMap*   mmap = (struct MultibootMMap*)MEM(MMAP_ADDR);
+  mbi              = (struct MultibootInfo*)MEM(MBI_ADDR);
+  mbi_magic        = MBI_MAGIC;
+  memset(mbi, 0, sizeof(struct MultibootInfo));
+  mbi->flags       = MBI_MEM_VALID | MBI_CMD_VALID
+                   | MBI_MODS_VALID | MBI_MMAP_VALID;
+  mbi->memLower    = 640;
+  mbi->memUpper    = (memSize << 10) - 1024;
+  mbi->cmdline     = STR_ADDR;
+  strcpy((char*)MEM(STR_ADDR), "/mimgload");
+  mbi->modsCount   = 1;
+  mbi->modsAddr    = MODS_ADDR;
+  mods[0].modStart  = start;
+  mods[0].modEnd    = start + len;
+  mods[0].modString = STR_ADDR + 16;
+  strcpy((char*)MEM(STR_ADDR + 16), "/image.gz");
+  mods[0].reserved  = 0;
+  if (dataAddr) {
+    mbi->modsCount    = 2;
+    mods[1].modStart  = dataAddr;
+    mods[1].modEnd    = dataAddr + DATA_LEN;
+    mods[1].modString = STR_ADDR + 32;
+    strcpy((char*)MEM(STR_ADDR + 32), "/data.bin");
+    mods[1].reserved  = 0;
+  }
+  memset(mmap, 0, 3*sizeof(struct MultibootMMap));
+  mmap[0].size     = 20;
+  mmap[0].lenLo    = 640 << 10;
+  mmap[0].type     = 1;
+  mmap[1].size     = 20;
+  mmap[1].baseLo   = 0x100000;
+  mmap[1].lenLo    = (memSize << 20) - 0x100000;
+  mmap[1].type     = 1;
+  mbi->mmapAddr    = MMAP_ADDR;
+  mbi->mmapLength  = 2*sizeof(struct MultibootMMap);
+  if (highSize) {                     /* Memory above 4GB is described in */
+    mmap[2].size   = 20;              /* the map, but is never touched.   */
+    mmap[2].baseHi = 1;
+    mmap[2].lenLo  = highSize << 20;
+    mmap[2].lenHi  = highSize >> 12;
+    mmap[2].type   = 1;
+    mbi->mmapLength += sizeof(struct MultibootMMap);
+  }
+}
+
+/* Place an image in simulated memory and set up the multiboot information
+ * to describe it.  Returns zero if the image does not fit.
+ */
+static int placeImage(unsigned char* img, unsigned len) {
+  if (len==0 || moduleAddr + len < moduleAddr
+             || moduleAddr + len > (memSize << 20)
+             || (dataAddr && dataAddr < moduleAddr + len
+                          && moduleAddr < dataAddr + DATA_LEN)) {
+    return 0;
+  }
+  memcpy(MEM(moduleAddr), img, len);
+  if (dataAddr) {
+    unsigned char* data = (unsigned char*)MEM(dataAddr);
+    unsigned       i;
+    for (i=0; i<DATA_LEN; i++) {
+      data[i] = DATA_BYTE(i);
+    }
+  }
+  initMBI(moduleAddr, len);
+  return 1;
+}
+
+/* Check the memory maps in a loaded BOOTDATA section:  The 32 bit map
+ * should describe the two regions below 4GB, and the 64 bit map should
+ * describe those regions and the region above 4GB, if there is one.
+ */
+static int checkMMaps(unsigned addr) {
+  struct BootData* bd  = (struct BootData*)MEM(addr);
+  unsigned*        mm  = (unsigned*)MEM(bd->mmap);
+  unsigned*        m64 = (unsigned*)MEM(bd->mmap64);
+  unsigned         top = (memSize << 20) - 1;
+  int              ok  = 1;
+  if (mm[0]!=2 || mm[1]!=0 || mm[2]!=(640<<10)-1
+               || mm[3]!=0x100000 || mm[4]!=top) {
+    fprintf(stderr, "BOOTDATA at %08x has incorrect memory map\n", addr);
+    ok = 0;
+  }
+  if (m64[0]!=(highSize ? 3 : 2)
+      || m64[5]!=0x100000 || m64[6]!=0 || m64[7]!=top || m64[8]!=0) {
+    ok = 0;
+  } else if (highSize) {
+    unsigned long long last = (1ULL << 32) + ((unsigned long long)highSize << 20) - 1;
+    if (m64[9]!=0 || m64[10]!=1
+        || m64[11]!=(unsigned)last || m64[12]!=(unsigned)(last >> 32)) {
+      ok = 0;
+    }
+  }
+  if (!ok) {
+    fprintf(stderr, "BOOTDATA at %08x has incorrect 64 bit memory map\n",
+            addr);
+  }
+  return ok;
+}
+
+/* ------------------------------------------------------------------------
+ * Checking results:  After an image has been loaded, each DATA section
+ * should hold the bytes from the image, and each ZERO section should be
+ * cleared.  (We check against the original copy of the image because
+ * loading is allowed to overwrite the image in simulated memory.)
+ */
+static int checkImage(unsigned char* img, unsigned len) {
+  unsigned pos = sizeof(struct MimgHeader);
+  int      ok  = 1;
+  while (pos + sizeof(struct SectionHeader) <= len) {
+    struct SectionHeader* sec  = (struct SectionHeader*)(img + pos);
+    unsigned              slen = 1 + (sec->last - sec->first);
+    unsigned char*        mem  = (unsigned char*)MEM(sec->first);
+    if (sec->type==DATA) {
+      if (memcmp(mem, img + pos + sizeof(struct SectionHeader), slen)) {
+        fprintf(stderr, "DATA section [%08x-%08x] not loaded correctly\n",
+                sec->first, sec->last);
+        ok = 0;
+      }
+    } else if (sec->type==BOOTDATA) {
+      ok &= checkMMaps(sec->first);
+    } else if (sec->type==ZERO) {
+      unsigned i;
+      for (i=0; i<slen; i++) {
+        if (mem[i]) {
+          fprintf(stderr, "ZERO section [%08x-%08x] not cleared\n",
+                  sec->first, sec->last);
+          ok = 0;
+          break;
+        }
+      }
+    }
+    pos += sizeof(struct SectionHeader);
+    if (sec->type==DATA) {
+      pos += slen;
+    } else if (sec->type==BOOTDATA) {
+      pos += HDRLEN(*(unsigned*)(sec+1));
+    }
+  }
+  if (dataAddr) {
+    unsigned char* data = (unsigned char*)MEM(dataAddr);
+    unsigned       i;
+    for (i=0; i<DATA_LEN; i++) {
+      if (data[i]!=DATA_BYTE(i)) {
+        fprintf(stderr, "data module at %08x overwritten\n", dataAddr);
+        ok = 0;
+        break;
+      }
+    }
+  }
+  return ok;
+}
+
+/* ------------------------------------------------------------------------
+ * Replaying images:
+ */
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned char* readFile(char* name, unsigned* len) {
+  FILE*          f = fopen(name, "rb");
+  unsigned char* buf;
+  long           size;
+  if (f==NULL) {
+    perror(name);
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  rewind(f);
+  if (size<=0 || (buf = malloc(size))==NULL
+              || fread(buf, 1, size, f)!=(size_t)size) {
+    fprintf(stderr, "%s: cannot read image\n", name);
+    fclose(f);
+    return NULL;
+  }
+  fclose(f);
+  *len = (unsigned)size;
+  return buf;
+}
+
+static int replay(char* name, unsigned char* img, unsigned len, int reps) {
+  double time = 0;
+  int    r;
+  memset(&simStats, 0, sizeof(simStats));
+  for (r=0; r<reps; r++) {
+    double t0;
+    if (!placeImage(img, len)) {
+      fprintf(stderr, "%s: image does not fit in simulated memory\n", name);
+      return 0;
+    }
+    simEntered = NOENTRY;
+    t0         = now();
+    mimgload();
+    time      += now() - t0;
+    if (simEntered==NOENTRY) {
+      fprintf(stderr, "%s: loader did not reach the entry point\n", name);
+      return 0;
+    }
+  }
+  if (!checkImage(img, len)) {
+    return 0;
+  }
+  printf("%s: %u bytes, entry 0x%08x\n", name, len, simEntered);
+  printf("  sections validated %llu, loaded %llu per run\n",
+         simStats.validated / reps, simStats.loaded / reps);
+  printf("  bytes copied %llu, zeroed %llu per run\n",
+         simStats.copied / reps, simStats.zeroed / reps);
+  printf("  %.3f ms per run (%d runs)\n", 1000 * time / reps, reps);
+  return 1;
+}
+
+/* ------------------------------------------------------------------------
+ * Fuzzing:  Each iteration either mutates one of the given images or
+ * generates a new random image that is (usually) valid, and then runs
+ * the validator on it.  If the validator accepts the image, we load it
+ * and check the result.
+ */
+static unsigned char* fuzzImg;
+static unsigned       fuzzLen;
+
+static void saveImage(char* name) {
+  FILE* f = fopen(name, "wb");
+  if (f) {
+    fwrite(fuzzImg, 1, fuzzLen, f);
+    fclose(f);
+  }
+}
+
+static void crashed(int sig) {
+  saveImage("mimgsim-crash.img");
+  fprintf(stderr, "loader crashed (signal %d); image saved in "
+                  "mimgsim-crash.img\n", sig);
+  _exit(2);
+}
+
+static unsigned rnd(unsigned n) {     /* Random number in [0..n) */
+  return n ? (unsigned)random() % n : 0;
+}
+
+static void put(unsigned char* buf, unsigned* pos, unsigned w) {
+  memcpy(buf + *pos, &w, 4);
+  *pos += 4;
+}
+
+/* Generate a random image with up to eight sections, laid out in order
+ * of increasing address above 1MB, but avoiding the loader.
+ */
+static unsigned randomImage(unsigned char* buf, unsigned max) {
+  unsigned pos   = 0;
+  unsigned addr  = 0x100000 + rnd(0x10000);
+  unsigned nsecs = 1 + rnd(8);
+  unsigned entry = NOENTRY;
+  unsigned i;
+  memcpy(buf, "mimg", 4);
+  pos = 4;
+  put(buf, &pos, 0);
+  put(buf, &pos, 0);                  /* entry point, filled in below   */
+  for (i=0; i<nsecs; i++) {
+    unsigned type = rnd(2) ? DATA : ZERO;
+    unsigned len  = 1 + rnd(0x4000);
+    if (pos + sizeof(struct SectionHeader) + len > max) {
+      break;
+    }
+    if (addr < LOADER_END && addr + len > LOADER_FIRST) {
+      addr = LOADER_END;
+    }
+    if (rnd(4)==0) {                  /* Sometimes load over the image  */
+      addr = moduleAddr + rnd(0x8000);
+    } else if (dataAddr && rnd(8)==0) {  /* or over the data module     */
+      addr = dataAddr + rnd(DATA_LEN);
+    }
+    put(buf, &pos, addr);
+    put(buf, &pos, addr + len - 1);
+    put(buf, &pos, 0);
+    put(buf, &pos, type);
+    if (type==DATA) {
+      unsigned j;
+      for (j=0; j<len; j++) {
+        buf[pos++] = (unsigned char)random();
+      }
+      if (entry==NOENTRY) {
+        entry = addr + rnd(len);
+      }
+    }
+    addr += len + rnd(0x1000);
+  }
+  memcpy(buf + 8, &entry, 4);
+  return pos;
+}
+
+/* Apply a small number of random mutations to an image, favoring the
+ * header fields where the interesting validation logic lives.
+ */
+static void mutate(unsigned char* buf, unsigned len) {
+  int n = 1 + rnd(4);
+  while (n-- > 0 && len>=4) {
+    unsigned pos = rnd(len - 3) & ~3;
+    switch (rnd(4)) {
+      case 0 : buf[rnd(len)] ^= 1 << rnd(8);
+               break;
+      case 1 : { unsigned w = random();
+                 memcpy(buf + pos, &w, 4); }
+               break;
+      case 2 : { unsigned w;
+                 memcpy(&w, buf + pos, 4);
+                 w += rnd(9) - 4;
+                 memcpy(buf + pos, &w, 4); }
+               break;
+      case 3 : { unsigned w = rnd(2) ? 0 : 0xffffffff;
+                 memcpy(buf + pos, &w, 4); }
+               break;
+    }
+  }
+}
+
+static int fuzz(unsigned char** imgs, unsigned* lens, int nimgs,
+                int iters) {
+  unsigned max      = 0x100000;
+  int      accepted = 0;
+  int      failed   = 0;
+  int      i;
+  fuzzImg = malloc(max);
+  signal(SIGSEGV, crashed);
+  signal(SIGBUS,  crashed);
+  for (i=0; i<iters; i++) {
+    char* msg;
+    if (nimgs>0) {
+      int k   = rnd(nimgs);
+      fuzzLen = lens[k] < max ? lens[k] : max;
+      memcpy(fuzzImg, imgs[k], fuzzLen);
+      if (rnd(8)==0) {
+        fuzzLen = 1 + rnd(fuzzLen);   /* truncate */
+      }
+    } else {
+      fuzzLen = randomImage(fuzzImg, max);
+    }
+    if (rnd(2)) {
+      mutate(fuzzImg, fuzzLen);
+    }
+    if (!placeImage(fuzzImg, fuzzLen)) {
+      continue;
+    }
+    msg = validImage(moduleAddr, moduleAddr + fuzzLen - 1);
+    if (msg==0) {
+      accepted++;
+      loadImage(moduleAddr, moduleAddr + fuzzLen - 1);
+      if (!checkImage(fuzzImg, fuzzLen) && failed++==0) {
+        saveImage("mimgsim-fail.img");
+      }
+    }
+  }
+  printf("fuzzing: %d iterations, %d images accepted, %d load failures\n",
+         iters, accepted, failed);
+  return failed==0;
+}
+
+/* ------------------------------------------------------------------------
+ * Main program:
+ */
+int main(int argc, char** argv) {
+  unsigned char** imgs;
+  unsigned*       lens;
+  int             nimgs = 0;
+  int             reps  = 1;
+  int             iters = 0;
+  int             ok    = 1;
+  int             opt;
+  int             i;
+
+  while ((opt = getopt(argc, argv, "m:H:a:d:r:f:s:v"))!=-1) {
+    switch (opt) {
+      case 'm' : memSize    = strtoul(optarg, 0, 0); break;
+      case 'H' : highSize   = strtoul(optarg, 0, 0); break;
+      case 'a' : moduleAddr = strtoul(optarg, 0, 0); break;
+      case 'd' : dataAddr   = strtoul(optarg, 0, 0); break;
+      case 'r' : reps       = atoi(optarg);          break;
+      case 'f' : iters      = atoi(optarg);          break;
+      case 's' : srandom(strtoul(optarg, 0, 0));     break;
+      case 'v' : simVerbose = 1;                     break;
+      default  : fprintf(stderr, "usage: %s [-m mb] [-H mb] [-a addr] [-d addr] "
+                                 "[-r n] [-f n] [-s seed] [-v] "
+                                 "[image ...]\n",
+                                 argv[0]);
+                 return 1;
+    }
+  }
+  if (memSize<2 || memSize>4095 || highSize>(1<<20) || reps<1) {
+    fprintf(stderr, "invalid memory size or repeat count\n");
+    return 1;
+  }
+
+  simMem = mmap(NULL, 1ULL << 32, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (simMem==MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  imgs = calloc(argc, sizeof(unsigned char*));
+  lens = calloc(argc, sizeof(unsigned));
+  for (i=optind; i<argc; i++) {
+    if ((imgs[nimgs] = readFile(argv[i], &lens[nimgs]))==NULL) {
+      return 1;
+    }
+    if (iters==0) {
+      ok &= replay(argv[i], imgs[nimgs], lens[nimgs], reps);
+    }
+    nimgs++;
+  }
+  if (iters>0) {
+    ok &= fuzz(imgs, lens, nimgs, iters);
+  }
+  return ok ? 0 : 1;
+}
+
+/* --------------------------------------------------------------------- */
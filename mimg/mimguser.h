@@ -2,16 +2,48 @@
 #define NOENTRY  0xffffffff /* Used to signal a missing entry point      */
 
 /* ------------------------------------------------------------------------
- * A BOOTDATA section starts with four pointers:
+ * A BOOTDATA section starts with five pointers:
  * - unsigned* hdrs   points to an array of header information
  * - unsigned* mmap   points to an array of memory map information
  * - char*     cmd    loader command line string
  * - char*     str    boot module command line string
+ * - unsigned* mods   points to an array of data module information
+ * - unsigned* mmap64 points to an array of 64 bit memory map information
+ *
+ * Data modules are any GRUB modules after the first (which holds the
+ * memory image itself).  They are left where GRUB put them, and each
+ * one is described by a pair of words giving its first and last byte
+ * addresses, in the same order as the module lines in grub.cfg.
+ *
+ * The mmap array only describes memory below 4GB (regions that cross
+ * the 4GB boundary are clipped), with a pair of words for each region.
+ * The mmap64 array describes every available region, including those
+ * above 4GB that can only be reached with PAE paging, using four words
+ * for each one: the low and high words of the first address, and then
+ * the low and high words of the last address.  Both arrays start with
+ * a count of the number of regions.
  * --------------------------------------------------------------------- */
 
+#ifndef MIMGSIM
 struct BootData {
   unsigned* headers;
   unsigned* mmap;
   char*     cmdline;
   char*     imgline;
+  unsigned* modules;
+  unsigned* mmap64;
 };
+#else
+/* The host-side simulator (mimgsim.c) may run on a 64 bit machine, so it
+ * uses a version of this structure with 32 bit addresses in place of the
+ * pointers.
+ */
+struct BootData {
+  unsigned headers;
+  unsigned mmap;
+  unsigned cmdline;
+  unsigned imgline;
+  unsigned modules;
+  unsigned mmap64;
+};
+#endif
@@ -0,0 +1,174 @@
+/* ------------------------------------------------------------------------
+ * profile.c:  A minimal profiling runtime for instrumented LC kernels
+ *
+ * When a kernel is built with "make PGO=gen", the optimized bitcode for
+ * the kernel is instrumented by opt (using the same IR level passes
+ * that clang uses for -fprofile-generate), so that every function and
+ * branch updates a counter in the __llvm_prf_cnts section as it runs.
+ * The standard profiling runtime in compiler-rt depends on a C library
+ * and a file system, so we use this small replacement instead: calling
+ * profileDump() builds a raw profile (in the same format that compiler-
+ * rt would write to default.profraw) and prints it as lines of hex on
+ * the serial port, between "PROFILE BEGIN" and "PROFILE END" markers.
+ * The host-side profraw tool turns this back in to a .profraw file for
+ * llvm-profdata.  Finally, we write to the isa-debug-exit port so that
+ * a headless QEMU that is running the workload exits at once.
+ *
+ * In a kernel that is not instrumented, the profile sections are empty
+ * and profileDump() returns without doing anything.
+ */
+
+typedef unsigned long long u64;
+typedef unsigned long      uptr;
+
+/* The raw profile format that this runtime produces must match the
+ * version of LLVM that is used to instrument the kernel and to read
+ * the profile; these values are taken from InstrProfData.inc in LLVM
+ * 14, which uses version 8 of the format.
+ */
+#define PROF_MAGIC(c) ((u64)255 << 56 | (u64)'l' << 48 | (u64)'p' << 40 | \
+                       (u64)'r' << 32 | (u64)'o' << 24 | (u64)'f' << 16 | \
+                       (u64)(c) << 8 | (u64)129)
+#define PROF_MAGIC_32    PROF_MAGIC('R')
+#define PROF_MAGIC_64    PROF_MAGIC('r')
+#define PROF_VALUE_KINDS 1         /* IPVK_Last                          */
+
+struct ProfHeader {
+  u64 magic;
+  u64 version;
+  u64 binaryIdsSize;
+  u64 dataSize;                    /* number of data records             */
+  u64 paddingBeforeCounters;
+  u64 countersSize;                /* number of counters                 */
+  u64 paddingAfterCounters;
+  u64 namesSize;                   /* bytes of (compressed) names        */
+  u64 countersDelta;
+  u64 namesDelta;
+  u64 valueKindLast;
+};
+
+/* Each data record is aligned to 8 bytes, but on a 32 bit machine, the
+ * last record in the section may not be followed by padding, so the
+ * length of the section is rounded up to a whole number of records.
+ */
+struct ProfData {                  /* Per-function data records          */
+  u64            nameRef;
+  u64            funcHash;
+  uptr           counterPtr;
+  uptr           functionPointer;
+  uptr           values;
+  unsigned       numCounters;
+  unsigned short numValueSites[PROF_VALUE_KINDS+1];
+} __attribute__((aligned(8)));
+
+/* The bounds of each section are provided by the linker script, and the
+ * version (including flags that identify an IR level profile) is
+ * emitted by the instrumentation pass, so it is missing from kernels
+ * that have not been instrumented.
+ */
+extern char __start___llvm_prf_data[],  __stop___llvm_prf_data[];
+extern char __start___llvm_prf_cnts[],  __stop___llvm_prf_cnts[];
+extern char __start___llvm_prf_names[], __stop___llvm_prf_names[];
+extern u64  __llvm_profile_raw_version __attribute__((weak));
+
+/* Instrumented code may refer to this symbol to pull in the runtime. */
+int __llvm_profile_runtime;
+
+/* Output on the serial port: --------------------------------------------*/
+
+#define COM1      0x3f8
+#define EXIT_PORT 0xf4             /* QEMU's default isa-debug-exit port */
+
+static inline void outb(unsigned short port, unsigned char val) {
+  asm volatile("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline unsigned char inb(unsigned short port) {
+  unsigned char val;
+  asm volatile("inb %1, %0" : "=a"(val) : "Nd"(port));
+  return val;
+}
+
+static void sputc(char c) {
+  while ((inb(COM1+5) & 0x20)==0) {
+    /* wait for the transmitter to be ready */
+  }
+  outb(COM1, c);
+}
+
+static void sputs(const char* s) {
+  while (*s) {
+    sputc(*s++);
+  }
+}
+
+/* The profile is printed 32 bytes to a line, with no separators: */
+static unsigned column = 0;
+
+static void hexBytes(const void* p, uptr len) {
+  static const char digits[] = "0123456789abcdef";
+  const unsigned char* b = p;
+  while (len-- > 0) {
+    sputc(digits[*b >> 4]);
+    sputc(digits[*b++ & 0xf]);
+    if (++column==32) {
+      sputc('\n');
+      column = 0;
+    }
+  }
+}
+
+static void hexZeros(uptr len) {
+  static const unsigned char zero = 0;
+  while (len-- > 0) {
+    hexBytes(&zero, 1);
+  }
+}
+
+static uptr padding(uptr len) {
+  return (8 - (len & 7)) & 7;
+}
+
+/* Dump the profile: -----------------------------------------------------*/
+
+void profileDump(void) {
+  struct ProfHeader h;
+  uptr dataLen  = __stop___llvm_prf_data  - __start___llvm_prf_data;
+  uptr cntsLen  = __stop___llvm_prf_cnts  - __start___llvm_prf_cnts;
+  uptr namesLen = __stop___llvm_prf_names - __start___llvm_prf_names;
+
+  if (&__llvm_profile_raw_version==0 || dataLen==0) {
+    return;                        /* Not an instrumented kernel         */
+  }
+
+  h.magic                 = sizeof(uptr)==8 ? PROF_MAGIC_64 : PROF_MAGIC_32;
+  h.version               = __llvm_profile_raw_version;
+  h.binaryIdsSize         = 0;
+  h.dataSize              = (dataLen + sizeof(struct ProfData) - 1)
+                          / sizeof(struct ProfData);
+  h.paddingBeforeCounters = 0;
+  h.countersSize          = cntsLen / sizeof(u64);
+  h.paddingAfterCounters  = 0;
+  h.namesSize             = namesLen;
+  h.countersDelta         = (uptr)__start___llvm_prf_cnts
+                          - (uptr)__start___llvm_prf_data;
+  h.namesDelta            = (uptr)__start___llvm_prf_names;
+  h.valueKindLast         = PROF_VALUE_KINDS;
+
+  sputs("\nPROFILE BEGIN\n");
+  column = 0;
+  hexBytes(&h, sizeof(h));
+  hexBytes(__start___llvm_prf_data,  dataLen);
+  hexZeros(h.dataSize * sizeof(struct ProfData) - dataLen);
+  hexBytes(__start___llvm_prf_cnts,  cntsLen);
+  hexBytes(__start___llvm_prf_names, namesLen);
+  hexZeros(padding(namesLen));
+  if (column!=0) {
+    sputc('\n');
+  }
+  sputs("PROFILE END\n");
+
+  outb(EXIT_PORT, 0);              /* Exit QEMU, if the device is present */
+}
+
+/* --------------------------------------------------------------------- */
@@ -0,0 +1,75 @@
+/* ------------------------------------------------------------------------
+ * profraw.c:  Extract a raw LLVM profile from a kernel's serial output
+ *
+ * Usage:  profraw [logfile] > kernel.profraw
+ *
+ * Reads the serial port output from a kernel that was instrumented with
+ * "make PGO=gen" and linked with profile.o, and writes the bytes that
+ * were printed in hex between the last "PROFILE BEGIN" and "PROFILE END"
+ * lines as a binary file that can be passed to "llvm-profdata merge".
+ * Only the first complete profile in the log is used.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static int hexval(int c) {
+  return isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+}
+
+int main(int argc, char** argv) {
+  FILE*          in      = stdin;
+  int            inProf  = 0;
+  unsigned char* buf     = NULL;
+  size_t         len     = 0;
+  size_t         max     = 0;
+  char           line[256];
+
+  if (argc>2) {
+    fprintf(stderr, "usage: %s [logfile]\n", argv[0]);
+    return 1;
+  }
+  if (argc==2 && (in = fopen(argv[1], "r"))==NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  while (fgets(line, sizeof(line), in) && inProf>=0) {
+    char* p;
+    if (strncmp(line, "PROFILE BEGIN", 13)==0) {
+      inProf = 1;
+      len    = 0;
+    } else if (strncmp(line, "PROFILE END", 11)==0) {
+      if (inProf) {
+        inProf = -1;             /* Stop at the end of the first profile */
+      }
+    } else if (inProf) {
+      for (p=line; isxdigit((unsigned char)p[0])
+                && isxdigit((unsigned char)p[1]); p+=2) {
+        if (len==max) {
+          max = max ? 2*max : 65536;
+          if ((buf = realloc(buf, max))==NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+          }
+        }
+        buf[len++] = (hexval(p[0]) << 4) | hexval(p[1]);
+      }
+      if (*p!='\n' && *p!='\r' && *p!='\0') {
+        fprintf(stderr, "unexpected characters in profile, ignored\n");
+        inProf = 0;
+      }
+    }
+  }
+
+  if (inProf>=0 || len==0) {
+    fprintf(stderr, "no complete profile found\n");
+    return 1;
+  }
+  fwrite(buf, 1, len, stdout);
+  fprintf(stderr, "%lu bytes of profile data\n", (unsigned long)len);
+  return 0;
+}
+
+/* --------------------------------------------------------------------- */
@@ -33,7 +33,10 @@
  *                
  ********************************************************************/
 
-/* No SHIFT key support!!! */
+/* No SHIFT key support!!!  This version polls the keyboard controller;
+ * kernels should use the interrupt driven driver in libs-lc/keyboard.llc
+ * instead, which also tracks the state of the modifier keys.
+ */
 
 #define KBD_STATUS_REG		0x64	
 #define KBD_CNTL_REG		0x64	
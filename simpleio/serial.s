@@ -5,6 +5,19 @@
         .text
         .globl	serial_putc
 serial_putc:
+
+        .ifdef  DEBUGCON        # Send output to QEMU's debug console?
+        pushl   %eax            # (see SERIALOPTS in the Makefile)
+        movb    8(%esp), %al
+        outb    %al, $0xe9      # No need to wait for the port
+        cmpb    $0xa, %al       # Was it a newline?
+        jnz     1f
+        movb    $0xd, %al       # Send a carriage return
+        outb    %al, $0xe9
+1:      popl    %eax
+        ret
+        .else
+
         pushl   %eax
         pushl   %edx
 
@@ -32,5 +45,6 @@ serial_putc:
 2:      popl    %edx
         popl    %eax
         ret
+        .endif
 
 #-- Done ---------------------------------------------------------------------
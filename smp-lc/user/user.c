@@ -0,0 +1,44 @@
+/* A simple program that runs as several user processes at the same time.
+ * Each process is passed a different process number, and uses it to pick
+ * a row on the screen where it displays a counter and the number of the
+ * cpu that it is currently running on.  The program does not use the
+ * simpleio library because that library keeps global state that would be
+ * shared between all of the processes.
+ */
+extern unsigned whichCPU(void);
+extern void     yield(void);
+
+#define VRAM ((volatile unsigned short*)0xb8000)
+#define ATTR 0x0700
+
+static volatile unsigned short* putstr(volatile unsigned short* p, char* s) {
+  while (*s) {
+    *p++ = ATTR | *s++;
+  }
+  return p;
+}
+
+static volatile unsigned short* puthex(volatile unsigned short* p,
+                                       unsigned n, int digits) {
+  while (digits-- > 0) {
+    *p++ = ATTR | "0123456789abcdef"[(n >> (4*digits)) & 0xf];
+  }
+  return p;
+}
+
+void cmain(unsigned id) {
+  volatile unsigned short* row = VRAM + 80*(2+id) + 48;
+  unsigned count = 0;
+  for (;;) { /* Don't return! */
+    volatile unsigned short* p = row;
+    p = putstr(p, "proc ");
+    p = puthex(p, id, 1);
+    p = putstr(p, " on cpu ");
+    p = puthex(p, whichCPU(), 1);
+    p = putstr(p, ": ");
+    p = puthex(p, count++, 8);
+    if ((count & 0xfffff)==0) {
+      yield();
+    }
+  }
+}
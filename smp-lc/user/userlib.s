@@ -0,0 +1,26 @@
+	.set	NPROCS, 8	# Number of processes (must match N in kernel.llc)
+
+	.text
+	.globl	entry
+entry:	movl	%eax, %ecx	# eax holds the process number
+	incl	%ecx
+	shll	$12, %ecx
+	leal	stacks(%ecx), %esp	# Each process has its own 4KB stack
+	pushl	%eax
+	call	cmain
+1:	jmp	1b
+
+	.data
+	.align	16
+stacks:	.space	4096*NPROCS	# User stacks
+
+	.text
+	# System call to find the number of the cpu we are running on
+	.globl	whichCPU
+whichCPU:
+	int	$128
+	ret
+
+	.globl	yield
+yield:	int     $129
+	ret
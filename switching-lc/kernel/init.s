@@ -28,11 +28,38 @@ entry:	cli			# Turn off interrupts
 
 	call	initGDT		# Set up global segment table
 	call	initIDT		# Set up interrupt descriptor table
+	call	initFPU		# Prepare for lazy FPU/SSE switching
 	call	kernel		# Enter main kernel
 
 1:	hlt			# Catch all, in case kernel returns
 	jmp	1b
 
+#--------------------------------------------------------------------------
+# FPU/SSE initialization:
+#
+# We enable the FXSAVE/FXRSTOR instructions and SSE exceptions (CR4.OSFXSR
+# and CR4.OSXMMEXCPT), make sure that FPU instructions are not emulated
+# (CR0.EM=0) and that WAIT/FWAIT honor the TS flag (CR0.MP=1), and then
+# set CR0.TS so that the first FPU or SSE instruction executed by any user
+# process will trigger a device-not-available (#NM) exception.  The kernel
+# itself is compiled without FPU/SSE code.
+#--------------------------------------------------------------------------
+
+	.set	CR0_MP,     0x002
+	.set	CR0_EM,     0x004
+	.set	CR0_TS,     0x008
+	.set	CR4_OSFXSR, 0x200
+	.set	CR4_OSXMM,  0x400
+
+initFPU:movl	%cr4, %eax
+	orl	$(CR4_OSFXSR|CR4_OSXMM), %eax
+	movl	%eax, %cr4
+	movl	%cr0, %eax
+	andl	$~CR0_EM, %eax
+	orl	$(CR0_MP|CR0_TS), %eax
+	movl	%eax, %cr0
+	ret
+
 #--------------------------------------------------------------------------
 # Task-state Segment (TSS):
 #
@@ -41,6 +68,9 @@ entry:	cli			# Turn off interrupts
 # we still need a tss to store the kernel stack pointer and segment.
 #--------------------------------------------------------------------------
 
+	.set	NO_IOMAP, 1000		# I/O bitmap base for no bitmap
+	.set	IOMAP_LEN, 128		# Bytes in bitmap (ports 0-0x3ff)
+
 	.data
 tss:	.short	0, RESERVED		# previous task link
 esp0:	.long	0			# esp0
@@ -61,13 +91,53 @@ esp0:	.long	0			# esp0
 	.short	0, RESERVED		# ldt segment selector
 	.short	0			# T bit
 	#
-	# For now, we set the I/O bitmap offset to a value beyond the limit
-	# of the tss; following Intel documentation, this means that there
-	# is no I/O permissions bitmap and all I/O instructions will
-	# generate exceptions when CPL > IOPL.
+	# The I/O bitmap base address is set to NO_IOMAP, a value beyond
+	# the limit of the tss, while the current process has not been
+	# granted any I/O ports; following Intel documentation, this means
+	# that there is no I/O permissions bitmap and all I/O instructions
+	# will generate exceptions when CPL > IOPL.  Otherwise it points to
+	# iomap, which holds a copy of the current process's bitmap, with
+	# one bit for each of the ports 0-0x3ff (a clear bit allows access).
+	# Ports above 0x3ff fall beyond the limit and are never accessible.
+	# The bitmap must be followed by a byte with all bits set.
 	#
-	.short	1000			# I/O bit map base address
+iobase:	.short	NO_IOMAP		# I/O bit map base address
+iomap:	.fill	IOMAP_LEN, 1, 0xff	# I/O permissions bitmap
+	.byte	0xff
 	.set	tss_len, .-tss
+	.set	IOMAP_BASE, iomap-tss
+
+#--------------------------------------------------------------------------
+# I/O permissions:  loadIOBitmap copies a 128 byte bitmap (one bit for
+# each of the ports 0-0x3ff) in to the tss and enables it;  the processor
+# reads the bitmap from memory on each I/O instruction, so no further
+# action is needed.  enableIOBitmap reenables the bitmap that is already
+# in the tss, and disableIOBitmap removes access to all ports.
+#--------------------------------------------------------------------------
+
+	.text
+	.globl	loadIOBitmap
+loadIOBitmap:
+	pushl	%esi
+	pushl	%edi
+	movl	12(%esp), %esi		# Copy bitmap in to the tss
+	leal	iomap, %edi
+	movl	$(IOMAP_LEN/4), %ecx
+	cld
+	rep movsl
+	popl	%edi
+	popl	%esi
+	# fall through to enableIOBitmap
+
+	.globl	enableIOBitmap
+enableIOBitmap:
+	movw	$IOMAP_BASE, iobase
+	ret
+
+	.globl	disableIOBitmap
+disableIOBitmap:
+	movw	$NO_IOMAP, iobase
+	ret
 
 #--------------------------------------------------------------------------
 # Initialize gdt:
@@ -230,12 +300,17 @@ idt:	.space	IDT_SIZE, 0		# zero initial entries
 	.endm
 
 initIDT:# Add descriptors for exception & interrupt handlers:
-	.irp	num, 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,16,17,18,19
+	.irp	num, 0,1,2,3,4,5,6,8,9,10,11,12,13,14,16,17,18,19
 	idtcalc	exc\num, slot=\num
 	.endr
 
+	# Device not available exceptions are used for lazy FPU switching:
+	idtcalc	handler=fpuTrap, slot=7
+
 	# Add descriptors for hardware irqs:
 	idtcalc	handler=timerInterrupt, slot=0x20
+	idtcalc	handler=keyboardInterrupt, slot=0x21
+	idtcalc	handler=spurious, slot=0xff
 
 	# Add descriptors for system calls:
         # These are the only idt entries that we will allow to be called from
@@ -243,6 +318,16 @@ initIDT:# Add descriptors for exception & interrupt handlers:
         # will be tagged with dpl=3
 	idtcalc	handler=kputc, slot=0x80, dpl=3
 	idtcalc	handler=yield, slot=0x81, dpl=3
+	idtcalc	handler=kgetc, slot=0x82, dpl=3
+	idtcalc	handler=ipcSend, slot=0x83, dpl=3
+	idtcalc	handler=ipcRecv, slot=0x84, dpl=3
+	idtcalc	handler=ipcCall, slot=0x85, dpl=3
+	idtcalc	handler=ipcReplyRecv, slot=0x86, dpl=3
+	idtcalc	handler=ktrace, slot=0x87, dpl=3
+	idtcalc	handler=kwrite, slot=0x88, dpl=3
+	idtcalc	handler=kring, slot=0x89, dpl=3
+	idtcalc	handler=kstats, slot=0x8a, dpl=3
+	idtcalc	handler=kprofile, slot=0x8b, dpl=3
 
 	# Install the new IDT:
 	lidt	idtptr
@@ -283,7 +368,7 @@ handle_exc\num:
 	exchandler num=4,  func=nohandler		# overflow
 	exchandler num=5,  func=nohandler		# bound
 	exchandler num=6,  func=nohandler		# undefined opcode
-	exchandler num=7,  func=nohandler		# nomath
+	# exception 7 (nomath) is handled by fpuTrap
 	exchandler num=8,  func=nohandler, errorcode=1	# doublefault
 	exchandler num=9,  func=nohandler		# coproc seg overrun
 	exchandler num=10, func=nohandler, errorcode=1	# invalid tss
@@ -330,8 +415,37 @@ handle_\name :
         .endm
 
 	syscall timerInterrupt
+	syscall	keyboardInterrupt
 	syscall	kputc
 	syscall	yield
+	syscall	kgetc
+	syscall	fpuTrap
+	syscall	ipcSend
+	syscall	ipcRecv
+	syscall	ipcCall
+	syscall	ipcReplyRecv
+	syscall	ktrace
+	syscall	kwrite
+	syscall	kring
+	syscall	kstats
+	syscall	kprofile
+
+	# Spurious interrupts from the local APIC do not need an EOI:
+handle_spurious:
+	iret
+
+#--------------------------------------------------------------------------
+# Idle loop:  Used by the scheduler when there are no runnable user
+# processes.  Each interrupt that arrives while we are idle is handled
+# on the kernel stack in the usual way, and the handler will either
+# switch to a process that has become runnable or call idle again.
+#--------------------------------------------------------------------------
+
+	.globl	idle
+idle:	leal	stack, %esp	# Discard any previous kernel stack frames
+	sti			# Enable interrupts
+1:	hlt			# Wait for an interrupt
+	jmp	1b
 
 #--------------------------------------------------------------------------
 # Switch to user mode:  Takes a single parameter, which provides the
@@ -0,0 +1,16 @@
+/* Code that is shared by the two user programs.
+ */
+#include "common.h"
+
+/* Use the FPU for long enough that we are likely to be preempted part
+ * way through the loop; the result will only be correct if the kernel
+ * saves and restores our floating point registers.
+ */
+int fpuCheck(double step, int n) {
+  double x = 0;
+  int i;
+  for (i=0; i<n; i++) {
+    x += step;
+  }
+  return (int)x;
+}
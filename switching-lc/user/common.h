@@ -0,0 +1,12 @@
+/* Definitions that are shared by the two user programs.
+ */
+
+/* The address of the flag in user that user2 sets to start the IPC
+ * benchmark.  user.ld places the .flag section, which holds nothing
+ * but the flag, at this address.
+ */
+#define FLAG_ADDR 0x400000
+
+/* Add step to itself n times in floating point (see common.c).
+ */
+extern int fpuCheck(double step, int n);
@@ -1,16 +1,78 @@
 /* A simple program that we will run in user mode.
  */
 #include "simpleio.h"
+#include "common.h"
 
 extern void kputc(unsigned);
+extern int  kwrite(char* buf, unsigned len);
 extern void yield(void);
+extern int  kgetc(void);
+extern int  ipc_call(unsigned dest, unsigned* msg);
+extern void ktrace(void);
+extern void kstats(void);
+extern void kprofile(void);
 
-volatile unsigned flag = 0;
+/* The flag is placed in a section of its own that user.ld puts at the
+ * very start of the program so that user2 can find it at FLAG_ADDR.
+ */
+volatile unsigned flag __attribute__((section(".flag"))) = 0;
+
+/* Wait for a key, giving up the CPU while none is available.  The low
+ * byte of the result is the character code; bits 8, 9, and 10 record
+ * the state of the shift, ctrl, and alt keys.
+ */
+int getkey() {
+  int k;
+  while ((k = kgetc()) < 0) {
+    yield();
+  }
+  return k;
+}
+
+/* Read the low 32 bits of the processor's time stamp counter.
+ */
+static inline unsigned rdtsc() {
+  unsigned lo;
+  asm volatile("rdtsc" : "=a"(lo) : : "edx");
+  return lo;
+}
 
+/* Measure the cost of an IPC round trip to the server in user2, which
+ * replies to each message by incrementing its first word.
+ */
+#define SERVER 1
+#define ROUNDS 1000
+
+void ipcBenchmark() {
+  unsigned msg[4] = { 0, 1, 2, 3 };
+  unsigned min    = 0xffffffff;
+  unsigned total  = 0;
+  int i;
+  for (i=0; i<ROUNDS; i++) {
+    unsigned start = rdtsc();
+    int      from  = ipc_call(SERVER, msg);
+    unsigned time  = rdtsc() - start;
+    if (from!=SERVER || msg[0]!=i+1) {
+      printf("IPC failed: from=%d, msg[0]=%d\n", from, msg[0]);
+      return;
+    }
+    if (time<min) {
+      min = time;
+    }
+    total += time;
+  }
+  printf("%d IPC round trips: min %d, avg %d cycles\n",
+         ROUNDS, min, total/ROUNDS);
+}
+
+/* Print a string in the kernel's window using a single system call.
+ */
 void kputs(char* s) {
-  while (*s) {
-    kputc(*s++);
+  unsigned len = 0;
+  while (s[len]) {
+    len++;
   }
+  kwrite(s, len);
 }
 
 void cmain() {
@@ -23,13 +85,23 @@ void cmain() {
     puts("hello, user console\n");
 //  yield();
   }
+  printf("fpu check: %d (expect 1000000)\n", fpuCheck(0.5, 2000000));
   printf("My flag is at 0x%x\n", &flag);
+  if ((unsigned)&flag!=FLAG_ADDR) {
+    printf("but user2 expects it at 0x%x!\n", FLAG_ADDR);
+  }
   while (flag==0) {
       /* do nothing */
   }
   printf("Somebody set my flag to %d!\n", flag);
+  ipcBenchmark();
+  ktrace();             // dump a timeline of the benchmark on the serial port
+  kstats();             // and the kernel's per-process statistics
+  kprofile();           // end of the PGO workload (see Makefile.pgo)
   puts("\n\nUser code does not return\n");
+  puts("Type some text:\n");
   for (;;) { /* Don't return! */
+    putchar(getkey() & 0xff);
   }
   puts("This message won't appear!\n");
 }
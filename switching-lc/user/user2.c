@@ -1,13 +1,37 @@
 /* A simple program that we will run in user mode.
  */
 #include "simpleio.h"
+#include "common.h"
 
 extern void kputc(unsigned);
+extern int  kring(void* ring);
 extern void yield(void);
+extern int  ipc_recv(unsigned* msg);
+extern int  ipc_replyrecv(unsigned dest, unsigned* msg);
+
+/* Output for the kernel's window is written to a ring that the kernel
+ * drains on each timer tick, so most calls to kputs do not need to make
+ * any system calls at all.  The layout of the ring must match the
+ * description in the kernel.  Each character must be stored in the ring
+ * before head is advanced to publish it, so there is a compiler barrier
+ * between the two (IA32 does not reorder stores, so no fence is needed).
+ */
+#define RINGSIZE 1024
+
+struct {
+  volatile unsigned head;
+  volatile unsigned tail;
+  char              buf[RINGSIZE];
+} ring;
 
 void kputs(char* s) {
   while (*s) {
-    kputc(*s++);
+    if (ring.head - ring.tail == RINGSIZE) {
+      kring(&ring);             /* ring is full: ask kernel to drain it */
+    }
+    ring.buf[ring.head % RINGSIZE] = *s++;
+    __asm__ volatile("" ::: "memory");
+    ring.head++;
   }
 }
 
@@ -16,16 +40,26 @@ void cmain() {
   setWindow(13, 11, 47, 32);   // user process on right hand side
   cls();
   puts("in user2 code\n");
+  kring(&ring);
   for (i=0; i<400; i++) {
     kputs("hello, kernel console2\n");
     puts("hello, user console2\n");
 //    yield();
   }
-  unsigned* flagAddr = (unsigned*)0x402744;
+  printf("fpu check: %d (expect 1000000)\n", fpuCheck(0.25, 4000000));
+  unsigned* flagAddr = (unsigned*)FLAG_ADDR;
   printf("flagAddr = 0x%x\n", flagAddr);
   *flagAddr = 1234;
-  puts("\n\nUser2 code does not return\n");
+
+  /* Act as a server, replying to each message that we receive with a
+   * copy in which the first word has been incremented:
+   */
+  unsigned msg[4];
+  int client = ipc_recv(msg);
+  puts("Serving IPC requests\n");
   for (;;) { /* Don't return! */
+    msg[0]++;
+    client = ipc_replyrecv(client, msg);
   }
   puts("This message won't appear!\n");
 }
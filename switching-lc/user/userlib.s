@@ -19,3 +19,76 @@ kputc:	pushl	%eax
 yield:	int     $129
 	ret
 
+
+	# System call to read a key without blocking; returns -1 if no key
+	.globl	kgetc
+kgetc:	int	$130
+	ret
+
+	# System call to print a block of text in the kernel's window;
+	# returns the number of characters printed
+	.globl	kwrite
+kwrite:	movl	4(%esp), %eax
+	movl	8(%esp), %ecx
+	int	$136
+	ret
+
+	# System call to register (and drain) an output ring for the
+	# kernel's window; returns 0 on success
+	.globl	kring
+kring:	movl	4(%esp), %eax
+	int	$137
+	ret
+
+	# System call to dump the kernel's event trace on the serial port
+	.globl	ktrace
+ktrace:	int	$135
+	ret
+
+	# System call to print per-process scheduling statistics on the
+	# serial port
+	.globl	kstats
+kstats:	int	$138
+	ret
+
+	# System call to mark the end of the workload: dumps the profile
+	# and stops QEMU in a kernel built with PGO=gen, and does nothing
+	# otherwise
+	.globl	kprofile
+kprofile:
+	int	$139
+	ret
+
+	# Synchronous IPC system calls: Each message is passed as an array
+	# of four words that are carried in the ebx, edx, esi, and edi
+	# registers, and the result of the call is returned in eax.  The
+	# ipc_recv call takes only a message pointer; the others also take
+	# the number of the partner process as their first argument.
+	.text
+	.macro	ipc name, num, msg
+	.globl	\name
+\name :	pushl	%ebx		# Save callee-saved registers
+	pushl	%esi
+	pushl	%edi
+	movl	16(%esp), %ecx	# Partner process (if any)
+	movl	\msg(%esp), %eax	# Load message registers
+	movl	(%eax), %ebx
+	movl	4(%eax), %edx
+	movl	8(%eax), %esi
+	movl	12(%eax), %edi
+	int	$\num
+	movl	\msg(%esp), %ecx	# Save message registers
+	movl	%ebx, (%ecx)
+	movl	%edx, 4(%ecx)
+	movl	%esi, 8(%ecx)
+	movl	%edi, 12(%ecx)
+	popl	%edi
+	popl	%esi
+	popl	%ebx
+	ret
+	.endm
+
+	ipc	ipc_send,      131, 20
+	ipc	ipc_recv,      132, 16
+	ipc	ipc_call,      133, 20
+	ipc	ipc_replyrecv, 134, 20
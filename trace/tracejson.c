@@ -0,0 +1,231 @@
+/* ------------------------------------------------------------------------
+ * tracejson.c:  Convert kernel event traces to Chrome trace format
+ *
+ * Usage:  tracejson [-m mhz] [logfile] > trace.json
+ *
+ * Reads the serial port output from a kernel that uses trace.llc (for
+ * example, by running "make run | tee log" in switching-lc), extracts
+ * the records between each "TRACE BEGIN" and "TRACE END" line, and
+ * writes them as a JSON trace that can be loaded in to chrome://tracing
+ * or https://ui.perfetto.dev.  Time stamp counter values are converted
+ * to microseconds using the clock rate that is specified by the -m
+ * option (default 1000MHz).
+ *
+ * Each processor is shown as a single track, divided in to slices for
+ * the time spent in the kernel (named for the interrupt, system call,
+ * or exception that caused the kernel to be entered), in each user
+ * process, and in the idle loop.  Context switches are shown as instant
+ * events.  A summary of the time spent in the kernel for each kind of
+ * entry is printed on stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Event codes; these must match the definitions in libs-lc/trace.llc */
+#define TRACE_IRQ        1
+#define TRACE_SYSCALL    2
+#define TRACE_EXCEPTION  3
+#define TRACE_PAGEFAULT  4
+#define TRACE_SWITCH     5
+#define TRACE_EXIT       6
+#define TRACE_IDLE       7
+
+#define MAXCPUS   256
+#define MAXKINDS  512           /* distinct kernel entry names          */
+
+enum { NONE, KERNEL, USER, IDLE };
+
+struct Slice {                  /* The slice that is open on each cpu   */
+  int                state;
+  unsigned long long start;
+  char               name[32];
+};
+
+struct Kind {                   /* Summary statistics for kernel entries */
+  char               name[32];
+  unsigned long long count;
+  unsigned long long total;
+  unsigned long long max;
+};
+
+static struct Slice       slices[MAXCPUS];
+static int                seen[MAXCPUS];
+static struct Kind        kinds[MAXKINDS];
+static size_t             nkinds = 0;
+static double             mhz    = 1000;
+static unsigned long long base   = ~0ULL;
+static int                first  = 1;
+
+struct Record {                 /* A single record from the trace       */
+  unsigned           cpu;
+  unsigned long long tsc;
+  unsigned           ev;
+  unsigned           arg;
+};
+
+static double usecs(unsigned long long tsc) {
+  return (tsc - base) / mhz;
+}
+
+/* Write a single JSON event, separated from the previous one by a comma.
+ */
+static void event(const char* fmt, ...) {
+  va_list args;
+  printf(first ? "\n  " : ",\n  ");
+  first = 0;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+static void summarize(const char* name, unsigned long long len) {
+  size_t i;
+  for (i=0; i<nkinds && strcmp(kinds[i].name, name); i++) {
+  }
+  if (i==nkinds) {
+    if (nkinds==MAXKINDS) {
+      return;
+    }
+    strcpy(kinds[nkinds++].name, name);
+  }
+  kinds[i].count++;
+  kinds[i].total += len;
+  if (len>kinds[i].max) {
+    kinds[i].max = len;
+  }
+}
+
+/* Close the slice (if any) that is open on the given cpu.
+ */
+static void closeSlice(unsigned cpu, unsigned long long tsc) {
+  struct Slice* s = slices + cpu;
+  if (s->state!=NONE && tsc>=s->start) {
+    event("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,"
+          "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+          s->name,
+          s->state==KERNEL ? "kernel" : s->state==USER ? "user" : "idle",
+          cpu, usecs(s->start), (tsc - s->start) / mhz);
+    if (s->state==KERNEL) {
+      summarize(s->name, tsc - s->start);
+    }
+  }
+  s->state = NONE;
+}
+
+static void openSlice(unsigned cpu, unsigned long long tsc, int state,
+                      const char* name) {
+  struct Slice* s = slices + cpu;
+  s->state = state;
+  s->start = tsc;
+  strncpy(s->name, name, sizeof(s->name)-1);
+  s->name[sizeof(s->name)-1] = '\0';
+}
+
+static void record(unsigned cpu, unsigned long long tsc,
+                   unsigned ev, unsigned arg) {
+  char name[32];
+  switch (ev) {
+    case TRACE_IRQ       : sprintf(name, "irq %u", arg);
+                           break;
+    case TRACE_SYSCALL   : sprintf(name, "syscall 0x%x", arg);
+                           break;
+    case TRACE_EXCEPTION : sprintf(name, "exception %u", arg);
+                           break;
+    case TRACE_PAGEFAULT : sprintf(name, "page fault");
+                           break;
+    case TRACE_SWITCH    : event("{\"name\":\"switch to %u\",\"ph\":\"i\","
+                                 "\"s\":\"t\",\"pid\":0,\"tid\":%u,"
+                                 "\"ts\":%.3f}", arg, cpu, usecs(tsc));
+                           return;
+    case TRACE_EXIT      : closeSlice(cpu, tsc);
+                           sprintf(name, "process %u", arg);
+                           openSlice(cpu, tsc, USER, name);
+                           return;
+    case TRACE_IDLE      : closeSlice(cpu, tsc);
+                           openSlice(cpu, tsc, IDLE, "idle");
+                           return;
+    default              : fprintf(stderr, "unknown event %u\n", ev);
+                           return;
+  }
+  /* All other events are entries in to the kernel */
+  closeSlice(cpu, tsc);
+  openSlice(cpu, tsc, KERNEL, name);
+}
+
+int main(int argc, char** argv) {
+  FILE*          in      = stdin;
+  int            inTrace = 0;
+  struct Record* recs    = NULL;
+  size_t         nrecs   = 0;
+  size_t         maxrecs = 0;
+  char           line[256];
+  int            opt;
+  size_t         i;
+
+  while ((opt = getopt(argc, argv, "m:"))!=-1) {
+    if (opt=='m' && (mhz = atof(optarg))>0) {
+      continue;
+    }
+    fprintf(stderr, "usage: %s [-m mhz] [logfile]\n", argv[0]);
+    return 1;
+  }
+  if (optind<argc && (in = fopen(argv[optind], "r"))==NULL) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  /* Read all of the records first so that we can find the earliest
+   * time stamp, which is used as the origin for the timeline.
+   */
+  while (fgets(line, sizeof(line), in)) {
+    unsigned cpu, hi, lo, ev, arg;
+    if (strncmp(line, "TRACE BEGIN", 11)==0) {
+      inTrace = 1;
+    } else if (strncmp(line, "TRACE END", 9)==0) {
+      inTrace = 0;
+    } else if (inTrace
+            && sscanf(line, "T %x %x %x %x %x", &cpu, &hi, &lo, &ev, &arg)==5
+            && cpu<MAXCPUS) {
+      if (nrecs==maxrecs) {
+        maxrecs = maxrecs ? 2*maxrecs : 1024;
+        if ((recs = realloc(recs, maxrecs * sizeof(struct Record)))==NULL) {
+          fprintf(stderr, "out of memory\n");
+          return 1;
+        }
+      }
+      recs[nrecs].cpu = cpu;
+      recs[nrecs].tsc = ((unsigned long long)hi << 32) | lo;
+      recs[nrecs].ev  = ev;
+      recs[nrecs].arg = arg;
+      if (recs[nrecs].tsc<base) {
+        base = recs[nrecs].tsc;
+      }
+      seen[cpu] = 1;
+      nrecs++;
+    }
+  }
+
+  printf("{\"traceEvents\":[");
+  for (i=0; i<nrecs; i++) {
+    record(recs[i].cpu, recs[i].tsc, recs[i].ev, recs[i].arg);
+  }
+  for (i=0; i<MAXCPUS; i++) {
+    if (seen[i]) {
+      event("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+            "\"args\":{\"name\":\"cpu %d\"}}", (int)i, (int)i);
+    }
+  }
+  printf("\n]}\n");
+
+  for (i=0; i<nkinds; i++) {
+    fprintf(stderr, "%-16s %8llu entries, avg %8.3f us, max %8.3f us\n",
+            kinds[i].name, kinds[i].count,
+            kinds[i].total / mhz / kinds[i].count, kinds[i].max / mhz);
+  }
+  return 0;
+}
+
+/* --------------------------------------------------------------------- */